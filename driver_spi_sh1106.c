@@ -5,935 +5,1801 @@
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 #include <linux/cdev.h>
+#include <linux/debugfs.h>
+#include <linux/eventfd.h>
+#include <linux/firmware.h>
+#include <linux/hrtimer.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/idr.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/pm_runtime.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "sh1106_core.h"
+#include "sh1106_bus.h"
+
+#define CREATE_TRACE_POINTS
+#include "sh1106_trace.h"
 
 #define DEVICE_NAME "oled_sh1106"
 #define CLASS_NAME "oled"
+#define OLED_MAX_DEVICES 8   // panels served by one module instance
 
-// IOCTL command codes
-#define IOCTL_INIT_DISPLAY               _IO('O', 0)
-#define IOCTL_DEINIT_DISPLAY             _IO('O', 1)
-#define IOCTL_SET_CURSOR                 _IOW('O', 2, struct cursor_pos)
-#define IOCTL_NEXT_LINE                  _IO('O', 3)
-#define IOCTL_PRINT_CHAR                 _IOW('O', 4, unsigned char)
-#define IOCTL_PRINT_STRING               _IOW('O', 5, char *)
-#define IOCTL_INVERT_DISPLAY             _IOW('O', 6, bool)
-#define IOCTL_SET_BRIGHTNESS             _IOW('O', 7, uint8_t)
-#define IOCTL_FILL_DISPLAY               _IOW('O', 11, uint8_t)
-#define IOCTL_CLEAR_DISPLAY              _IO('O', 12)
-#define IOCTL_PRINT_LOGO                 _IO('O', 13)
-
-
-// Structures for complex IOCTL commands
-struct cursor_pos
-{
-    uint8_t line_no;
-    uint8_t cursor_pos;
-};
 // Function prototypes for character device operations
 static int oled_open(struct inode *inodep, struct file *filep);
 static int oled_release(struct inode *inodep, struct file *filep);
 static long oled_ioctl(struct file *filep, unsigned int cmd, unsigned long arg);
+static int oled_mmap(struct file *filep, struct vm_area_struct *vma);
+static ssize_t oled_write(struct file *filep, const char __user *buf, size_t count, loff_t *ppos);
+static ssize_t oled_read(struct file *filep, char __user *buf, size_t count, loff_t *ppos);
+static __poll_t oled_poll(struct file *filep, poll_table *wait);
 
 
 #define SH1106_RST_PIN         (  24 )   // Reset pin is GPIO 24
 #define SH1106_DC_PIN          (  23 )   // Data/Command pin is GPIO 23
-#define SH1106_MAX_SEG         ( 128 )   // Maximum segment
-#define SH1106_MAX_LINE        (   7 )   // Maximum line
-#define SH1106_DEF_FONT_SIZE   (   5 )   // Default font size
-
-
-extern int OLED_spi_write( uint8_t data );
-extern int  OLED_SH1106_DisplayInit(void);
-extern void OLED_SH1106_DisplayDeInit(void);
-void OLED_SH1106_SetCursor( uint8_t x, uint8_t y );
-void OLED_SH1106_GoToNextLine( void );
-void OLED_SH1106_PrintChar(unsigned char c);
-void OLED_SH1106_String(char *str);
-void OLED_SH1106_InvertDisplay(bool need_to_invert);
-void OLED_SH1106_SetBrightness(uint8_t brightnessValue);
-void OLED_SH1106_fill( uint8_t data );
-void OLED_SH1106_PrintLogo( void );
-void OLED_Display(void);
-void OLED_Display_On(void);
-void OLED_Display_Off(void);
-void OLED_Clear(uint8_t dat);
-
-
-static struct spi_device *OLED_spi_device; // SPI device
+#define OLED_WRITE_CHUNK       ( 256 )   // Bytes copied from userspace at once
+#define OLED_MAX_STRING        ( 4096 )  // Longest IOCTL_PRINT_STRING string
+
+
+/*
+** Per-device state of the driver, wrapping the panel of the core. It is
+** the same for every bus, the backend in bus only moves bytes.
+** OLED_SH1106_Flush() only queues the flush worker, so callers never
+** wait for the bus.
+**
+** fb is a whole page of its own so that it can be mapped into
+** userspace.
+**
+** lock protects the panel's framebuffer, dirty spans, cursor and console;
+** bus_lock serialises everything that drives DC or the bus. When both
+** are needed, lock is taken first. Every panel has its own workqueue, so
+** panels on different buses or chip selects flush in parallel.
+**
+** The structure is reference counted: open files keep it alive after
+** the bus device is gone, their calls then fail with -ENODEV.
+**
+** Every call and every flush holds a runtime PM reference on the bus
+** device. Once it has been idle for the autosuspend delay the panel
+** sleeps (display and DC-DC off, RAM kept) and the next access wakes
+** it. System sleep may cut the panel supply, so the wake after it
+** rewrites the display RAM from panel.shown. That copy belongs to
+** bus_lock like the rest of the panel state, runtime resume cannot take
+** lock as it runs inside calls that hold it.
+**
+** Animations are played by anim_timer, which only counts frames that
+** are due and queues anim_work on the panel's workqueue. anim_work
+** decodes the due frames under lock and flushes once, so a late worker
+** catches up without drifting. The animation holds a runtime PM
+** reference while it plays.
+**
+** Every flush request submits a frame: the dirty spans are planned
+** right away and the frame is queued with its own copy of the front
+** buffer, so later drawing cannot change it. The flush worker sends the
+** queue in order and completes each frame after its send. A full queue
+** is handled by queue_policy, frames merged into another one complete
+** with it.
+*/
+struct oled_qframe
+{
+    struct sh1106_frame plan;                 // plan.data points to data
+    u64 seq;                                  // submitted count when last changed
+    ktime_t queued;                           // first submission, for the flush latency
+    u8 data[SH1106_PAGES][SH1106_MAX_SEG] SH1106_DMA_ALIGNED;
+};
+
+struct oled_sh1106
+{
+    struct kref ref;
+    struct device *parent;                    // SPI or I2C device of the panel
+    const struct oled_bus *bus;
+    void *bus_ctx;                            // handed to bus->write()
+    struct cdev cdev;
+    struct device device;                     // /dev/oled_sh1106N, holds a reference until its release
+    struct device *dev;                       // &device once registered
+    int minor;
+    bool removed;                             // bus device unbound, protected by lock
+    struct gpio_desc *reset;                  // logical 1 holds the panel in reset, may be NULL on I2C
+    struct gpio_desc *dc;                     // 0 = command, 1 = data, NULL on I2C
+    struct mutex lock;
+    struct mutex bus_lock;
+    struct workqueue_struct *wq;              // ordered, runs flush_work
+    struct work_struct flush_work;
+    struct oled_qframe *queue[OLED_QUEUE_MAX_DEPTH + 1];   // oldest first, unused buffers after queue_len
+    u32 queue_len;                            // frames in queue, protected by lock like the rest
+    u32 queue_alloc;                          // buffers allocated in queue
+    u32 queue_depth;                          // frames that may wait behind the one being sent
+    u32 queue_policy;                         // OLED_QUEUE_*
+    bool queue_busy;                          // queue[0] is on the bus
+    atomic64_t frame_submitted;               // written under lock, read anywhere
+    atomic64_t frame_completed;               // written by the flush worker only
+    wait_queue_head_t frame_wait;             // woken when frames complete
+    struct eventfd_ctx *eventfd;              // signalled when frames complete, protected by lock
+    bool ram_lost;                            // display RAM needs a rewrite on wake, set by system sleep
+    struct hrtimer anim_timer;
+    struct work_struct anim_work;
+    atomic_t anim_due;                        // frames due since anim_work last ran
+    wait_queue_head_t anim_wait;              // woken when playback ends
+    u8 *anim_data;                            // frame records, protected by lock like the rest
+    u32 anim_len;
+    u32 anim_count;
+    ktime_t anim_period;
+    u32 anim_mode;                            // OLED_ANIM_*, OLED_ANIM_STOP when idle
+    u32 anim_frame;                           // next frame to show
+    u32 anim_pos;                             // its offset in anim_data
+    struct dentry *debugfs;
+    struct sh1106_panel panel;
+};
+
+static inline struct oled_sh1106 *to_oled(struct sh1106_panel *panel)
+{
+    return container_of(panel, struct oled_sh1106, panel);
+}
+
+
+static void OLED_SH1106_FlushWork( struct work_struct *work );
+static void oled_anim_work(struct work_struct *work);
+static enum hrtimer_restart oled_anim_tick(struct hrtimer *timer);
+static int oled_queue_wait(struct oled_sh1106 *oled, struct file *filep);
+
+
 static struct class *oled_class = NULL; // Class pointer for device cla
-static int major_number; //major number
+static dev_t oled_devt;                 // first device number of the region
+static DEFINE_IDA(oled_minors);         // minor numbers in use
+
+// Cost of one bus transfer in bytes for the flush planner, read at every flush
+static unsigned int xfer_cost = SH1106_XFER_COST;
+module_param(xfer_cost, uint, 0644);
+MODULE_PARM_DESC(xfer_cost, "Cost of a bus transfer in bytes, gaps up to about twice this are resent instead of re-addressed");
+
+// Leave panels running on unbind so that the next probe can skip the reset
+static bool keep_panel;
+module_param(keep_panel, bool, 0644);
+MODULE_PARM_DESC(keep_panel, "Keep the panel on across module reloads, the next init skips the reset");
+
+// Idle time before a panel sleeps, per device in power/autosuspend_delay_ms afterwards
+static int autosuspend_ms = 30000;
+module_param(autosuspend_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_ms, "Idle time in ms before the display is switched off, -1 keeps it on");
 
 // File operations structure
 static struct file_operations fops = {
     .open = oled_open,
     .release = oled_release,
     .unlocked_ioctl = oled_ioctl,
+    .mmap = oled_mmap,
+    .write = oled_write,
+    .read = oled_read,
+    .poll = oled_poll,
 };
 
 
+static void oled_free_dev(struct kref *ref);
+
 // Open function
 static int oled_open(struct inode *inodep, struct file *filep)
 {
-    pr_info("OLED device opened\n");
+    struct oled_sh1106 *oled = container_of(inodep->i_cdev, struct oled_sh1106, cdev);
+
+    // the cdev held by chrdev_open() pins the device and with it the state
+    kref_get(&oled->ref);
+    filep->private_data = oled;
+    dev_dbg(oled->dev, "opened\n");
     return 0;
 }
 
 // Release function
 static int oled_release(struct inode *inodep, struct file *filep)
 {
-    pr_info("OLED device closed\n");
+    struct oled_sh1106 *oled = filep->private_data;
+
+    dev_dbg(oled->dev, "closed\n");
+    kref_put(&oled->ref, oled_free_dev);
     return 0;
 }
 
-// IOCTL function
-static long oled_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+// Keep the panel awake for a call, called with lock held and the device not removed
+static int oled_pm_get(struct oled_sh1106 *oled)
 {
-    struct cursor_pos cursor;
-    char *str = NULL;
-    unsigned char c;
-    bool invert;
-    uint8_t value;
-    switch (cmd)
-    {
-        case IOCTL_INIT_DISPLAY:
-            OLED_SH1106_DisplayInit();
-            pr_info("OLED initialized\n");
-            break;
-        case IOCTL_DEINIT_DISPLAY:
-            OLED_SH1106_DisplayDeInit();
-            pr_info("OLED deinitialized\n");
-            break;
-        case IOCTL_SET_CURSOR:
-            if (copy_from_user(&cursor, (struct cursor_pos __user *)arg, sizeof(cursor)))
-                return -EFAULT;
-            OLED_SH1106_SetCursor(cursor.line_no, cursor.cursor_pos);
-            pr_info("Cursor set to line %d, position %d\n", cursor.line_no, cursor.cursor_pos);
-            break;
-        case IOCTL_NEXT_LINE:
-            OLED_SH1106_GoToNextLine();
-            pr_info("Cursor moved to next line\n");
-            break;
-        case IOCTL_PRINT_CHAR:
-            if (copy_from_user(&c, (unsigned char __user *)arg, sizeof(c)))
-                return -EFAULT;
-            OLED_SH1106_PrintChar(c);
-            pr_info("Printed character %c\n", c);
-            break;
-        case IOCTL_PRINT_STRING:
-            str = kzalloc(256, GFP_KERNEL);
-            if (!str)
-                return -ENOMEM;
-            if (copy_from_user(str, (char __user *)arg, 255))
-            {
-                kfree(str);
-                return -EFAULT;
-            }
-            OLED_SH1106_String(str);
-            kfree(str);
-            pr_info("Printed string\n");
-            break;
-        case IOCTL_INVERT_DISPLAY:
-            if (copy_from_user(&invert, (bool __user *)arg, sizeof(invert)))
-                return -EFAULT;
-            OLED_SH1106_InvertDisplay(invert);
-            pr_info("Inverted display: %d\n", invert);
-            break;
-        case IOCTL_SET_BRIGHTNESS:
-            if (copy_from_user(&value, (uint8_t __user *)arg, sizeof(value)))
-                return -EFAULT;
-            OLED_SH1106_SetBrightness(value);
-            pr_info("Set brightness to %d\n", value);
-            break;
+    return pm_runtime_resume_and_get(oled->parent);
+}
 
-        case IOCTL_FILL_DISPLAY:
-            if (copy_from_user(&value, (uint8_t __user *)arg, sizeof(value)))
-                return -EFAULT;
-            OLED_SH1106_fill(value);
-            pr_info("Filled display with 0x%x\n", value);
-            break;
-        case IOCTL_CLEAR_DISPLAY:
-            OLED_Clear(0x00);
-            pr_info("Cleared display\n");
-            break;
-        case IOCTL_PRINT_LOGO:
-            OLED_SH1106_PrintLogo();
-            pr_info("Printed logo\n");
-            break;
-        default:
-            return -EINVAL;
-    }
-    return 0;
+static void oled_pm_put(struct oled_sh1106 *oled)
+{
+    pm_runtime_mark_last_busy(oled->parent);
+    pm_runtime_put_autosuspend(oled->parent);
 }
 
-// Probe function
-static int oled_probe(struct spi_device *spi)
+// mmap function, maps the framebuffer page into userspace
+static int oled_mmap(struct file *filep, struct vm_area_struct *vma)
 {
-    struct device *dev;
-    int ret;
-    u32 spi_freq;
-    major_number = register_chrdev(0, DEVICE_NAME, &fops);
-    if (major_number < 0)
-    {
-        pr_err("Failed to register char device\n");
-        return major_number;
-    }
-    if (!oled_class)
-    {
-        oled_class = class_create(THIS_MODULE, CLASS_NAME);
-        if (IS_ERR(oled_class))
-        {
-            pr_err("Failed to create class\n");
-            unregister_chrdev(major_number, DEVICE_NAME);
-            printk(KERN_ERR "Failed to register device class\n");
-            return PTR_ERR(oled_class);
-        }
-    }
+    struct oled_sh1106 *oled = filep->private_data;
+
+    if (vma->vm_pgoff != 0 || (vma->vm_end - vma->vm_start) > PAGE_SIZE)
+        return -EINVAL;
+
+    // vm_insert_page() takes a page reference, so a mapping may outlive the device
+    return vm_insert_page(vma, vma->vm_start, virt_to_page(oled->panel.fb));
+}
+
+// Write function, feeds the text console and renders once per call
+static ssize_t oled_write(struct file *filep, const char __user *buf, size_t count, loff_t *ppos)
+{
+    struct oled_sh1106 *oled = filep->private_data;
+    size_t done = 0, len;
+    ssize_t ret = 0;
+    char *chunk;
+
+    chunk = kmalloc(OLED_WRITE_CHUNK, GFP_KERNEL);
+    if (!chunk)
+        return -ENOMEM;
 
-    dev = device_create(oled_class, NULL, MKDEV(major_number, 0), NULL, DEVICE_NAME);
-    if (IS_ERR(dev))
+    mutex_lock(&oled->lock);
+    if (oled->removed)
     {
-        pr_err("Failed to create device\n");
-        unregister_chrdev(major_number, DEVICE_NAME);
-        class_destroy(oled_class);
-        printk(KERN_ERR "Failed to create the device\n");
-        return PTR_ERR(dev);
+        ret = -ENODEV;
+        goto out;
     }
-
-    // Get SPI frequency from device tree
-    ret = of_property_read_u32(spi->dev.of_node, "spi-max-frequency", &spi_freq);
+    ret = oled_queue_wait(oled, filep);
     if (ret)
+        goto out;
+    ret = oled_pm_get(oled);
+    if (ret < 0)
+        goto out;
+
+    while (done < count)
     {
-        pr_err("Failed to read SPI frequency from device tree\n");
-        unregister_chrdev(major_number, DEVICE_NAME);
-        device_destroy(oled_class, MKDEV(major_number, 0));
-        class_destroy(oled_class);
-        return ret;
+        len = min_t(size_t, count - done, OLED_WRITE_CHUNK);
+        if (copy_from_user(chunk, buf + done, len))
+        {
+            ret = -EFAULT;
+            break;
+        }
+        OLED_SH1106_ConsoleWrite(&oled->panel, chunk, len);
+        done += len;
     }
 
-    // Set up SPI device
-    spi->max_speed_hz = spi_freq;
-    spi_setup(spi);
-    OLED_spi_device = spi;
+    OLED_SH1106_ConsoleRender(&oled->panel);
+    OLED_SH1106_Flush(&oled->panel);
+    oled_pm_put(oled);
+out:
+    mutex_unlock(&oled->lock);
+    kfree(chunk);
+    return done ? done : ret;
+}
 
-    pr_info("OLED SPI driver probed\n");
+// Print a NUL terminated userspace string at the text cursor, a string that is too long draws nothing
+static long oled_print_string(struct oled_sh1106 *oled, const char __user *ustr)
+{
+    long len;
+    char *str;
+
+    len = strnlen_user(ustr, OLED_MAX_STRING);   // counts the NUL
+    if (len == 0)
+        return -EFAULT;
+    if (len > OLED_MAX_STRING)
+        return -E2BIG;
+    if (len == 1)
+        return 0;
+
+    str = memdup_user(ustr, len - 1);
+    if (IS_ERR(str))
+        return PTR_ERR(str);
+    OLED_SH1106_Text(&oled->panel, str, len - 1);
+    kfree(str);
     return 0;
 }
 
-// Remove function
-static void oled_remove(struct spi_device *spi)
+// End playback and wake the waiters, called with the framebuffer lock held
+static void oled_anim_stop(struct oled_sh1106 *oled)
+{
+    if (oled->anim_mode == OLED_ANIM_STOP)
+        return;
+
+    oled->anim_mode = OLED_ANIM_STOP;
+    hrtimer_cancel(&oled->anim_timer);   // the timer callback takes no locks
+    atomic_set(&oled->anim_due, 0);
+    wake_up_interruptible(&oled->anim_wait);
+    oled_pm_put(oled);
+}
+
+// Check and store an animation, called with the framebuffer lock held
+static long oled_anim_load(struct oled_sh1106 *oled, unsigned long arg)
 {
-    if (OLED_spi_device)
+    struct oled_anim anim;
+    struct oled_anim_frame hdr;
+    u32 pos = 0, i;
+    u8 *data;
+
+    if (copy_from_user(&anim, (struct oled_anim __user *)arg, sizeof(anim)))
+        return -EFAULT;
+    if (anim.count == 0 || anim.count > OLED_ANIM_MAX_FRAMES || anim.len > OLED_ANIM_MAX_DATA)
+        return -E2BIG;
+    if (anim.frame_us < OLED_ANIM_MIN_FRAME_US)
+        return -EINVAL;
+
+    data = vmemdup_user(u64_to_user_ptr(anim.data), anim.len);
+    if (IS_ERR(data))
+        return PTR_ERR(data);
+
+    // every record has to decode, playback cannot report errors
+    for (i = 0; i < anim.count; i++)
     {
-        OLED_spi_device = NULL;
+        if (anim.len - pos < sizeof(hdr))
+            break;
+        memcpy(&hdr, data + pos, sizeof(hdr));
+        pos += sizeof(hdr);
+        if (anim.len - pos < hdr.len ||
+            OLED_SH1106_UploadCheck(data + pos, hdr.len, hdr.format))
+            break;
+        pos += hdr.len;
     }
-    if (oled_class)
+    if (i < anim.count || pos != anim.len)
     {
-        unregister_chrdev(major_number, DEVICE_NAME);
-        device_destroy(oled_class, MKDEV(major_number, 0));
-        class_destroy(oled_class);
+        kvfree(data);
+        return -EINVAL;
     }
-    OLED_SH1106_DisplayDeInit();
-    pr_info("OLED SPI driver removed\n");
+
+    oled_anim_stop(oled);
+    kvfree(oled->anim_data);
+    oled->anim_data = data;
+    oled->anim_len = anim.len;
+    oled->anim_count = anim.count;
+    oled->anim_period = ns_to_ktime((u64)anim.frame_us * NSEC_PER_USEC);
+    return 0;
 }
 
-// SPI write function
-int OLED_spi_write(uint8_t data)
+// Start or stop playback, called with the framebuffer lock held
+static long oled_anim_play(struct oled_sh1106 *oled, unsigned long arg)
 {
-    int ret = -1;
-    uint8_t rx = 0x00;
-
-    if (OLED_spi_device) // after declaration, it will return 1
-    {
-        // prepare data
-        struct spi_transfer tr = {
-            .tx_buf = &data,
-            .rx_buf = &rx,
-            .len = 1,
-        };
-        // transfer data
-        ret = spi_sync_transfer(OLED_spi_device, &tr, 1);
-    }
-    return (ret);
-}
+    u32 mode;
+    int ret;
 
-// Device tree compatible strings
-static const struct of_device_id oled_spi_dt_ids[] = {
-    {.compatible = "sh1106"},
-    {},
-};
-MODULE_DEVICE_TABLE(of, oled_spi_dt_ids);
+    if (copy_from_user(&mode, (u32 __user *)arg, sizeof(mode)))
+        return -EFAULT;
+    if (mode > OLED_ANIM_LOOP)
+        return -EINVAL;
 
-// SPI driver structure
-static struct spi_driver oled_spi_driver = {
-    .driver = {
-        .name = "oled_spi_driver",
-        .of_match_table = of_match_ptr(oled_spi_dt_ids),
-    },
-    .probe = oled_probe,
-    .remove = oled_remove,
-    
-};
+    oled_anim_stop(oled);
+    if (mode == OLED_ANIM_STOP)
+        return 0;
+    if (!oled->anim_data)
+        return -ENODATA;
 
-// Module initialization
-static int __init oled_init(void)
-{
-    int ret;
-    ret = spi_register_driver(&oled_spi_driver);
+    ret = oled_pm_get(oled);   // dropped by oled_anim_stop()
     if (ret < 0)
-    {
-        unregister_chrdev(major_number, DEVICE_NAME);
-        pr_err("Failed to register SPI driver\n");
         return ret;
-    }
-    OLED_SH1106_DisplayDeInit();
-
 
-    pr_info("OLED driver initialized\n");
+    oled->anim_mode = mode;
+    oled->anim_frame = 0;
+    oled->anim_pos = 0;
+    atomic_set(&oled->anim_due, 1);   // the first frame right away
+    queue_work(oled->wq, &oled->anim_work);
+    hrtimer_start(&oled->anim_timer, oled->anim_period, HRTIMER_MODE_REL);
     return 0;
 }
 
-// Module cleanup
-static void __exit oled_exit(void)
+// Animation timer, counts the due frames and leaves the drawing to anim_work
+static enum hrtimer_restart oled_anim_tick(struct hrtimer *timer)
 {
-    spi_unregister_driver(&oled_spi_driver);
-    if (oled_class)
-    {
-        class_destroy(oled_class);
-    }
-    unregister_chrdev(major_number, DEVICE_NAME);
-    OLED_SH1106_DisplayDeInit();
-    pr_info("OLED driver exited\n");
-}
-
-
-static uint8_t SH1106_LineNum   = 0;
-static uint8_t SH1106_CursorPos = 0;
-static uint8_t SH1106_FontSize  = SH1106_DEF_FONT_SIZE;
-
+    struct oled_sh1106 *oled = container_of(timer, struct oled_sh1106, anim_timer);
 
+    // a late timer counts every period it missed
+    atomic_add(hrtimer_forward_now(timer, oled->anim_period), &oled->anim_due);
+    queue_work(oled->wq, &oled->anim_work);
+    return HRTIMER_RESTART;
+}
 
-#define PAGESIZE    8          //page size
-#define XLevelL		 0x02       //column low address
-#define XLevelH		 0x10       //column high address
-#define YLevel       0xB0       //page address
-#define	Brightness	 0xFF 
-#define WIDTH 	     128        //oled screen width
-#define HEIGHT 	     64	        //oled screen height
 /*
-**  EmbeTronicX Logo
+** Animation worker, decodes the frames that are due and flushes once.
+** Frames missed by a late worker are still decoded, the deltas build on
+** them, but only the newest one is sent.
 */
-static uint8_t OLED_logo[1024] = {
-  0xFF, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xE1, 0xF9, 0xFF, 0xF9, 0xE1, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xF8, 0xFF, 0x0F, 0xFF, 0xFF, 0xFF, 0x3F, 0xFF,
-  0xF8, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0xFF, 0xFF, 0x0F, 0xF8, 0xF7, 0x00, 0xBF, 0xC0, 0x7F,
-  0xFF, 0xFF, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x3F, 0xE0, 0x0F, 0x7F, 0x00, 0xFF, 0x7F, 0x80,
-  0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x04, 0xFC, 0xFC, 0x0C, 0x0C, 0x0C, 0x0C, 0x7C, 0x00, 0x00, 0x00,
-  0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x04, 0xFC, 0xF8,
-  0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x08,
-  0x04, 0x04, 0xFC, 0xFC, 0x04, 0x04, 0x04, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x98, 0x98, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80,
-  0x00, 0x00, 0x04, 0x0C, 0x38, 0xE0, 0x80, 0xE0, 0x38, 0x0C, 0x04, 0x00, 0x00, 0x00, 0x00, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xC0, 0x3F, 0xFF, 0xFF, 0x00, 0xFD, 0xFE, 0xFF,
-  0x01, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x06, 0x06, 0x06, 0x06, 0xE0, 0x00, 0x00, 0x00,
-  0x00, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF,
-  0x00, 0x00, 0xFF, 0xFE, 0x00, 0x00, 0x00, 0x7C, 0xFF, 0x11, 0x10, 0x1F, 0x1F, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x7C, 0xFF, 0x01, 0x00, 0x01, 0xFF, 0x7C, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x87,
-  0x00, 0x00, 0x00, 0x00, 0xE0, 0x3F, 0x1F, 0xFF, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x1F, 0x3F, 0xFC, 0xF7, 0x00, 0xDF, 0xE3, 0x7D,
-  0x3E, 0x07, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x00, 0x00, 0x00,
-  0x00, 0x03, 0x03, 0x00, 0x03, 0x03, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03,
-  0x02, 0x02, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x03, 0x02, 0x02, 0x01, 0x00, 0x00, 0x00,
-  0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x00, 0x01, 0x03, 0x02, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x03,
-  0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x01, 0x03, 0x03, 0x02, 0x02, 0x03,
-  0x00, 0x00, 0x02, 0x03, 0x01, 0x00, 0x00, 0x00, 0x01, 0x03, 0x02, 0x00, 0x00, 0x00, 0x00, 0xFF,
-  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xFF, 0x00, 0xFF, 0x03, 0x00,
-  0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0x88, 0x88, 0x08, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x20, 0xE0,
-  0x00, 0xFC, 0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xFC, 0x00,
-  0xE0, 0x20, 0x20, 0xFC, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xFC, 0x00, 0x00,
-  0x00, 0x08, 0x08, 0xF8, 0x08, 0x08, 0x00, 0xE0, 0x00, 0xE0, 0x00, 0xFC, 0x20, 0x20, 0x00, 0xE0,
-  0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0x00, 0xEC, 0x00, 0x20, 0x20, 0x20, 0xE0, 0x00, 0xFC,
-  0x00, 0xE0, 0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0xC8, 0x38, 0x00, 0x00, 0xE0,
-  0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x00, 0x00, 0x00, 0xFF,
-  0xFF, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x9C, 0x9C, 0x88, 0x8E, 0x83, 0x98, 0x83, 0x8E, 0x88,
-  0x88, 0x9C, 0x9C, 0x80, 0x80, 0x87, 0x84, 0x84, 0x84, 0x80, 0x87, 0x80, 0x80, 0x87, 0x80, 0x87,
-  0x80, 0x87, 0x84, 0x84, 0x87, 0x80, 0x87, 0x85, 0x85, 0x85, 0x80, 0x87, 0x84, 0x84, 0x87, 0x80,
-  0x87, 0x84, 0x84, 0x87, 0x80, 0x87, 0x85, 0x85, 0x85, 0x80, 0x87, 0x84, 0x84, 0x87, 0x80, 0x80,
-  0x80, 0x80, 0x80, 0x87, 0x80, 0x80, 0x80, 0x87, 0x84, 0x87, 0x80, 0x87, 0x84, 0x84, 0x80, 0x87,
-  0x84, 0x84, 0x87, 0x80, 0x87, 0x80, 0x80, 0x80, 0x87, 0x80, 0x87, 0x85, 0x85, 0x87, 0x80, 0x87,
-  0x80, 0x85, 0x85, 0x85, 0x87, 0x80, 0x80, 0x80, 0x80, 0x86, 0x85, 0x84, 0x84, 0x84, 0x80, 0x87,
-  0x84, 0x84, 0x87, 0x80, 0x87, 0x80, 0x87, 0x80, 0x87, 0x85, 0x85, 0x85, 0x80, 0x80, 0x80, 0xFF,
-};
-static const uint8_t OLED_buffer[1024] = 
-{
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
-};
-
-
-/*
-** Array Variable to store the letters.
-*/ 
-static const unsigned char SH1106_font[][SH1106_DEF_FONT_SIZE]= 
-{
-    {0x00, 0x00, 0x00, 0x00, 0x00},   // space
-    {0x00, 0x00, 0x2f, 0x00, 0x00},   // !
-    {0x00, 0x07, 0x00, 0x07, 0x00},   // "
-    {0x14, 0x7f, 0x14, 0x7f, 0x14},   // #
-    {0x24, 0x2a, 0x7f, 0x2a, 0x12},   // $
-    {0x23, 0x13, 0x08, 0x64, 0x62},   // %
-    {0x36, 0x49, 0x55, 0x22, 0x50},   // &
-    {0x00, 0x05, 0x03, 0x00, 0x00},   // '
-    {0x00, 0x1c, 0x22, 0x41, 0x00},   // (
-    {0x00, 0x41, 0x22, 0x1c, 0x00},   // )
-    {0x14, 0x08, 0x3E, 0x08, 0x14},   // *
-    {0x08, 0x08, 0x3E, 0x08, 0x08},   // +
-    {0x00, 0x00, 0xA0, 0x60, 0x00},   // ,
-    {0x08, 0x08, 0x08, 0x08, 0x08},   // -
-    {0x00, 0x60, 0x60, 0x00, 0x00},   // .
-    {0x20, 0x10, 0x08, 0x04, 0x02},   // /
-    {0x3E, 0x51, 0x49, 0x45, 0x3E},   // 0
-    {0x00, 0x42, 0x7F, 0x40, 0x00},   // 1
-    {0x42, 0x61, 0x51, 0x49, 0x46},   // 2
-    {0x21, 0x41, 0x45, 0x4B, 0x31},   // 3
-    {0x18, 0x14, 0x12, 0x7F, 0x10},   // 4
-    {0x27, 0x45, 0x45, 0x45, 0x39},   // 5
-    {0x3C, 0x4A, 0x49, 0x49, 0x30},   // 6
-    {0x01, 0x71, 0x09, 0x05, 0x03},   // 7
-    {0x36, 0x49, 0x49, 0x49, 0x36},   // 8
-    {0x06, 0x49, 0x49, 0x29, 0x1E},   // 9
-    {0x00, 0x36, 0x36, 0x00, 0x00},   // :
-    {0x00, 0x56, 0x36, 0x00, 0x00},   // ;
-    {0x08, 0x14, 0x22, 0x41, 0x00},   // <
-    {0x14, 0x14, 0x14, 0x14, 0x14},   // =
-    {0x00, 0x41, 0x22, 0x14, 0x08},   // >
-    {0x02, 0x01, 0x51, 0x09, 0x06},   // ?
-    {0x32, 0x49, 0x59, 0x51, 0x3E},   // @
-    {0x7C, 0x12, 0x11, 0x12, 0x7C},   // A
-    {0x7F, 0x49, 0x49, 0x49, 0x36},   // B
-    {0x3E, 0x41, 0x41, 0x41, 0x22},   // C
-    {0x7F, 0x41, 0x41, 0x22, 0x1C},   // D
-    {0x7F, 0x49, 0x49, 0x49, 0x41},   // E
-    {0x7F, 0x09, 0x09, 0x09, 0x01},   // F
-    {0x3E, 0x41, 0x49, 0x49, 0x7A},   // G
-    {0x7F, 0x08, 0x08, 0x08, 0x7F},   // H
-    {0x00, 0x41, 0x7F, 0x41, 0x00},   // I
-    {0x20, 0x40, 0x41, 0x3F, 0x01},   // J
-    {0x7F, 0x08, 0x14, 0x22, 0x41},   // K
-    {0x7F, 0x40, 0x40, 0x40, 0x40},   // L
-    {0x7F, 0x02, 0x0C, 0x02, 0x7F},   // M
-    {0x7F, 0x04, 0x08, 0x10, 0x7F},   // N
-    {0x3E, 0x41, 0x41, 0x41, 0x3E},   // O
-    {0x7F, 0x09, 0x09, 0x09, 0x06},   // P
-    {0x3E, 0x41, 0x51, 0x21, 0x5E},   // Q
-    {0x7F, 0x09, 0x19, 0x29, 0x46},   // R
-    {0x46, 0x49, 0x49, 0x49, 0x31},   // S
-    {0x01, 0x01, 0x7F, 0x01, 0x01},   // T
-    {0x3F, 0x40, 0x40, 0x40, 0x3F},   // U
-    {0x1F, 0x20, 0x40, 0x20, 0x1F},   // V
-    {0x3F, 0x40, 0x38, 0x40, 0x3F},   // W
-    {0x63, 0x14, 0x08, 0x14, 0x63},   // X
-    {0x07, 0x08, 0x70, 0x08, 0x07},   // Y
-    {0x61, 0x51, 0x49, 0x45, 0x43},   // Z
-    {0x00, 0x7F, 0x41, 0x41, 0x00},   // [
-    {0x55, 0xAA, 0x55, 0xAA, 0x55},   // Backslash (Checker pattern)
-    {0x00, 0x41, 0x41, 0x7F, 0x00},   // ]
-    {0x04, 0x02, 0x01, 0x02, 0x04},   // ^
-    {0x40, 0x40, 0x40, 0x40, 0x40},   // _
-    {0x00, 0x03, 0x05, 0x00, 0x00},   // `
-    {0x20, 0x54, 0x54, 0x54, 0x78},   // a
-    {0x7F, 0x48, 0x44, 0x44, 0x38},   // b
-    {0x38, 0x44, 0x44, 0x44, 0x20},   // c
-    {0x38, 0x44, 0x44, 0x48, 0x7F},   // d
-    {0x38, 0x54, 0x54, 0x54, 0x18},   // e
-    {0x08, 0x7E, 0x09, 0x01, 0x02},   // f
-    {0x18, 0xA4, 0xA4, 0xA4, 0x7C},   // g
-    {0x7F, 0x08, 0x04, 0x04, 0x78},   // h
-    {0x00, 0x44, 0x7D, 0x40, 0x00},   // i
-    {0x40, 0x80, 0x84, 0x7D, 0x00},   // j
-    {0x7F, 0x10, 0x28, 0x44, 0x00},   // k
-    {0x00, 0x41, 0x7F, 0x40, 0x00},   // l
-    {0x7C, 0x04, 0x18, 0x04, 0x78},   // m
-    {0x7C, 0x08, 0x04, 0x04, 0x78},   // n
-    {0x38, 0x44, 0x44, 0x44, 0x38},   // o
-    {0xFC, 0x24, 0x24, 0x24, 0x18},   // p
-    {0x18, 0x24, 0x24, 0x18, 0xFC},   // q
-    {0x7C, 0x08, 0x04, 0x04, 0x08},   // r
-    {0x48, 0x54, 0x54, 0x54, 0x20},   // s
-    {0x04, 0x3F, 0x44, 0x40, 0x20},   // t
-    {0x3C, 0x40, 0x40, 0x20, 0x7C},   // u
-    {0x1C, 0x20, 0x40, 0x20, 0x1C},   // v
-    {0x3C, 0x40, 0x30, 0x40, 0x3C},   // w
-    {0x44, 0x28, 0x10, 0x28, 0x44},   // x
-    {0x1C, 0xA0, 0xA0, 0xA0, 0x7C},   // y
-    {0x44, 0x64, 0x54, 0x4C, 0x44},   // z
-    {0x00, 0x10, 0x7C, 0x82, 0x00},   // {
-    {0x00, 0x00, 0xFF, 0x00, 0x00},   // |
-    {0x00, 0x82, 0x7C, 0x10, 0x00},   // }
-    {0x00, 0x06, 0x09, 0x09, 0x06}    // ~ (Degrees)
-};
-
-/****************************************************************************
- * Name: OLED_sh1106_ResetDcInit
- *
- * Details : This function Initializes and Configures the Reset and DC Pin
- ****************************************************************************/
-static int OLED_sh1106_ResetDcInit( void )
+static void oled_anim_work(struct work_struct *work)
 {
-  int ret = 0;
-    
-  //do while(false) loop to break if any error
-  do
-  {
-    
-    /* Register the Reset GPIO */
-    
-    //Checking the Reset GPIO is valid or not
-    if( gpio_is_valid( SH1106_RST_PIN ) == false )
-    {
-      pr_err("Reset GPIO %d is not valid\n", SH1106_RST_PIN);
-      ret = -1;
-      break;
-    }
-    
-    //Requesting the Reset GPIO
-    if( gpio_request( SH1106_RST_PIN, "SH1106_RST_PIN" ) < 0 )
-    {
-      pr_err("ERROR: Reset GPIO %d request\n", SH1106_RST_PIN);
-      ret = -1;
-      break;
-    }
-    
-    //configure the Reset GPIO as output
-    gpio_direction_output( SH1106_RST_PIN, 1 );
-    
-    /* Register the DC GPIO */
-    
-    //Checking the DC GPIO is valid or not
-    if( gpio_is_valid( SH1106_DC_PIN ) == false )
-    {
-      pr_err("DC GPIO %d is not valid\n", SH1106_DC_PIN);
-      gpio_free( SH1106_RST_PIN );   // free the reset GPIO
-      ret = -1;
-      break;
-    }
-    
-    //Requesting the DC GPIO
-    if( gpio_request( SH1106_DC_PIN, "SH1106_DC_PIN" ) < 0 )
+    struct oled_sh1106 *oled = container_of(work, struct oled_sh1106, anim_work);
+    struct oled_anim_frame hdr;
+    int due;
+
+    mutex_lock(&oled->lock);
+    due = atomic_xchg(&oled->anim_due, 0);
+    while (due-- > 0 && oled->anim_mode != OLED_ANIM_STOP)
     {
-      pr_err("ERROR: DC GPIO %d request\n", SH1106_DC_PIN);
-      gpio_free( SH1106_RST_PIN );   // free the reset GPIO
-      ret = -1;
-      break;
+        if (oled->anim_frame == oled->anim_count)
+        {
+            if (oled->anim_mode == OLED_ANIM_ONCE)
+            {
+                oled_anim_stop(oled);
+                break;
+            }
+            oled->anim_frame = 0;
+            oled->anim_pos = 0;
+        }
+        // checked by oled_anim_load(), cannot fail
+        memcpy(&hdr, oled->anim_data + oled->anim_pos, sizeof(hdr));
+        oled->anim_pos += sizeof(hdr);
+        OLED_SH1106_Upload(&oled->panel, oled->anim_data + oled->anim_pos, hdr.len, hdr.format);
+        oled->anim_pos += hdr.len;
+        oled->anim_frame++;
     }
-    
-    //configure the Reset GPIO as output
-    gpio_direction_output( SH1106_DC_PIN, 1 );
-    
-  } while( false );
-  
-  //pr_info("DC Reset GPIOs init Done!\n");
-  return( ret );
+    if (!oled->removed)
+        OLED_SH1106_Flush(&oled->panel);
+    mutex_unlock(&oled->lock);
 }
 
-
-static void OLED_SH1106_ResetDcDeInit( void )
+// Wait for the end of playback, without the framebuffer lock
+static long oled_anim_wait(struct oled_sh1106 *oled)
 {
-  gpio_free( SH1106_RST_PIN );   // free the reset GPIO
-  gpio_free( SH1106_DC_PIN );    // free the DC GPIO
+    return wait_event_interruptible(oled->anim_wait,
+                                    READ_ONCE(oled->anim_mode) == OLED_ANIM_STOP ||
+                                    READ_ONCE(oled->removed));
 }
 
-
-static void OLED_SH1106_setRst( uint8_t value )
+// Frames waiting behind the one on the bus, called with lock held
+static u32 oled_queue_waiting(struct oled_sh1106 *oled)
 {
-  gpio_set_value( SH1106_RST_PIN, value );
+    return oled->queue_len - oled->queue_busy;
 }
 
-
-static void OLED_SH1106_setDc( uint8_t value )
+// True while OLED_QUEUE_BLOCK holds back the next frame, also used without the lock as a hint
+static bool oled_queue_full(struct oled_sh1106 *oled)
 {
-  gpio_set_value( SH1106_DC_PIN, value );
+    return READ_ONCE(oled->queue_policy) == OLED_QUEUE_BLOCK &&
+           READ_ONCE(oled->queue_len) - READ_ONCE(oled->queue_busy) >= READ_ONCE(oled->queue_depth);
 }
 
-
-static int OLED_SH1106_Write( bool is_cmd, uint8_t data )
+// Add the columns of an older plan to a newer one, whose data already holds them
+static void oled_queue_merge(uint32_t (*into)[SH1106_DIRTY_WORDS], const uint32_t (*from)[SH1106_DIRTY_WORDS])
 {
-  int     ret = 0;
-  uint8_t pin_value;
-
-  if( is_cmd )
-  {
-    //DC pin has to be low, if this is command.
-    pin_value = 0u;
-  }
-  else
-  {
-    //DC pin has to be high, if this is data.
-    pin_value = 1u;
-  }
-  
-  OLED_SH1106_setDc( pin_value );
-  
-  //pr_info("Writing 0x%02X \n", data);
-  
-  //send the byte
-  ret = OLED_spi_write( data );
-  
-  return( ret );
-}
+    unsigned int page, word;
 
-/****************************************************************************
- * Name: OLED_SH1106_SetCursor
- *
- * Details : This function is specific to the SSD_1306 OLED.
- *
- * Argument:
- *              lineNo    -> Line Number
- *              cursorPos -> Cursor Position
- * 
- ****************************************************************************/
-void OLED_SH1106_SetCursor( uint8_t x, uint8_t y )
-{
-  OLED_SH1106_Write(true,YLevel+y/PAGESIZE);
-	OLED_SH1106_Write(true,(((x+2)&0xf0)>>4)|0x10);
-	OLED_SH1106_Write(true,((x+2)&0x0f)); 
-  SH1106_LineNum = YLevel+y/PAGESIZE;
+    for (page = 0; page < SH1106_PAGES; page++)
+        for (word = 0; word < SH1106_DIRTY_WORDS; word++)
+            into[page][word] |= from[page][word];
 }
 
-
-void OLED_SH1106_GoToNextLine( void )
+// Take queue[i] out and park its buffer behind the used ones, called with lock held
+static void oled_queue_remove(struct oled_sh1106 *oled, u32 i)
 {
+    struct oled_qframe *f = oled->queue[i];
 
-  SH1106_LineNum++;
-  SH1106_LineNum = (SH1106_LineNum & SH1106_MAX_LINE);
-  OLED_SH1106_SetCursor(SH1106_LineNum,0); /* Finally move it to next line */
+    memmove(&oled->queue[i], &oled->queue[i + 1], (oled->queue_alloc - i - 1) * sizeof(f));
+    oled->queue[oled->queue_alloc - 1] = f;
+    oled->queue_len--;
 }
 
-/****************************************************************************
- * Name: OLED_SH1106_PrintChar
- *
- * Details : This function is specific to the SSD_1306 OLED and sends 
- *           the single char to the OLED.
- * 
- * Arguments:
- *           c   -> character to be written
- * 
- ****************************************************************************/
-void OLED_SH1106_PrintChar( unsigned char c )
+// Drop the oldest waiting frame, the frame after it takes over its columns
+static void oled_queue_drop_oldest(struct oled_sh1106 *oled)
 {
-  uint8_t data_byte;
-  uint8_t temp = 0;
-  
+    u32 i = oled->queue_busy;
 
-  if( (( SH1106_CursorPos + SH1106_FontSize ) >= SH1106_MAX_SEG ) ||
-      ( c == '\n' )
-  )
-  {
-    OLED_SH1106_GoToNextLine();
-  }
-  
-  // print charcters other than new line
-  if( c != '\n' )
-  {
-  
-
-    c -= 0x20;  //or c -= ' ';
-    do
-    {
-      data_byte= SH1106_font[c][temp];         // Get the data to be displayed from LookUptable
-      OLED_SH1106_Write(false, data_byte);  // write data to the OLED
-      SH1106_CursorPos++;
-      
-      temp++;
-      
-    } while ( temp < SH1106_FontSize);
-    
-    OLED_SH1106_Write(false, 0x00);         //Display the data
-    SH1106_CursorPos++;
-  }
+    oled_queue_merge(oled->queue[i + 1]->plan.cols, oled->queue[i]->plan.cols);
+    oled->queue[i + 1]->queued = oled->queue[i]->queued;
+    oled_queue_remove(oled, i);
+    oled->panel.stats.queue_dropped++;
 }
 
-
-void OLED_SH1106_String(char *str)
+// Wait for room under OLED_QUEUE_BLOCK, called and returns with lock held
+static int oled_queue_wait(struct oled_sh1106 *oled, struct file *filep)
 {
-  while( *str )
-  {
-    OLED_SH1106_PrintChar(*str++);
-  }
-}
-
-
+    int ret;
 
-void OLED_SH1106_InvertDisplay(bool need_to_invert)
-{
-  if(need_to_invert)
-  {
-    OLED_SH1106_Write(true, 0xA7); // Invert the display
-  }
-  else
-  {
-    OLED_SH1106_Write(true, 0xA6); // Normal display
-  }
+    while (oled_queue_full(oled))
+    {
+        if (filep->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        mutex_unlock(&oled->lock);
+        ret = wait_event_interruptible(oled->frame_wait,
+                                       !oled_queue_full(oled) || READ_ONCE(oled->removed));
+        mutex_lock(&oled->lock);
+        if (ret)
+            return ret;
+        if (oled->removed)
+            return -ENODEV;
+    }
+    return 0;
 }
 
-
-void OLED_SH1106_SetBrightness(uint8_t brightnessValue)
+// Hand the waiting frames back to the dirty spans when they cannot be sent, called with lock held
+static void oled_queue_abort(struct oled_sh1106 *oled)
 {
-    OLED_SH1106_Write(true, 0x81);            // Contrast command
-    OLED_SH1106_Write(true, brightnessValue); // Contrast value (default value = 0x7F)
+    while (oled->queue_len > oled->queue_busy)
+    {
+        oled_queue_merge(oled->panel.dirty, oled->queue[oled->queue_len - 1]->plan.cols);
+        oled->queue_len--;
+    }
 }
 
+// Set depth and policy of the frame queue
+static long oled_queue_set(struct oled_sh1106 *oled, unsigned long arg)
+{
+    struct oled_qframe *f;
+    struct oled_queue q;
 
+    if (copy_from_user(&q, (struct oled_queue __user *)arg, sizeof(q)))
+        return -EFAULT;
+    if (q.depth < 1 || q.depth > OLED_QUEUE_MAX_DEPTH || q.policy > OLED_QUEUE_BLOCK)
+        return -EINVAL;
 
+    // one buffer more for the frame on the bus, buffers are kept until the device goes
+    while (oled->queue_alloc < q.depth + 1)
+    {
+        f = kmalloc(sizeof(*f), GFP_KERNEL);
+        if (!f)
+            return -ENOMEM;
+        oled->queue[oled->queue_alloc++] = f;
+    }
 
+    oled->queue_depth = q.depth;
+    oled->queue_policy = q.policy;
+    while (oled_queue_waiting(oled) > oled->queue_depth)
+        oled_queue_drop_oldest(oled);
+    wake_up_interruptible(&oled->frame_wait);   // blocked writers may fit now
+    return 0;
+}
 
-void OLED_SH1106_fill( uint8_t data )
+// Report the frame queue
+static long oled_queue_get(struct oled_sh1106 *oled, unsigned long arg)
 {
-  // 8 pages x 128 segments x 8 bits of data
-  unsigned int total  = ( SH1106_MAX_SEG * (SH1106_MAX_LINE + 1) );
-  unsigned int i      = 0;
-  
-  //Fill the Display
-  for(i = 0; i < total; i++)
-  {
-    OLED_SH1106_Write(false, data);
-  }
+    struct oled_queue q = {
+        .depth = oled->queue_depth,
+        .policy = oled->queue_policy,
+        .queued = oled_queue_waiting(oled),
+        .dropped = oled->panel.stats.queue_dropped,
+        .coalesced = oled->panel.stats.coalesced,
+    };
+
+    if (copy_to_user((struct oled_queue __user *)arg, &q, sizeof(q)))
+        return -EFAULT;
+    return 0;
 }
 
-
-void OLED_SH1106_ClearDisplay( void )
+// True while the flush worker has frames left to send
+static bool oled_frame_busy(struct oled_sh1106 *oled)
 {
-  //Set cursor
-  OLED_SH1106_SetCursor(0,0);
-  
-  OLED_SH1106_fill( 0x00 );
+    return atomic64_read(&oled->frame_completed) != atomic64_read(&oled->frame_submitted);
 }
 
-
-void OLED_SH1106_PrintLogo( void )
+// Mark frames up to seq as done after a dequeue, called by the flush worker with the framebuffer lock held
+static void oled_frame_done(struct oled_sh1106 *oled, u64 seq)
 {
-  int i;
-  
-  //Set cursor
-  OLED_SH1106_SetCursor(0,0);
-  
-  for( i = 0; i < ( SH1106_MAX_SEG * (SH1106_MAX_LINE + 1) ); i++ )
-  {
-    OLED_SH1106_Write(false, OLED_logo[i]);
-  }
+    if (seq != atomic64_read(&oled->frame_completed))
+    {
+        atomic64_set(&oled->frame_completed, seq);
+        if (oled->eventfd)
+            eventfd_signal(oled->eventfd, 1);
+    }
+    wake_up_interruptible(&oled->frame_wait);   // the queue has room again in any case
 }
 
-void OLED_Display_On(void)
+// Wait until frame seq (0 for all submitted ones) is done, without the framebuffer lock
+static long oled_frame_wait(struct oled_sh1106 *oled, unsigned long arg)
 {
-	OLED_SH1106_Write(true,0X8D);  //SET DCDC command
-	OLED_SH1106_Write(true,0X14);  //DCDC ON
-	OLED_SH1106_Write(true,0XAF);  //DISPLAY ON
+    u64 seq;
+    long ret;
+
+    if (copy_from_user(&seq, (__u64 __user *)arg, sizeof(seq)))
+        return -EFAULT;
+    if (seq == 0)
+        seq = atomic64_read(&oled->frame_submitted);
+    else if (seq > atomic64_read(&oled->frame_submitted))
+        return -EINVAL;
+
+    ret = wait_event_interruptible(oled->frame_wait,
+                                   atomic64_read(&oled->frame_completed) >= seq ||
+                                   READ_ONCE(oled->removed));
+    if (!ret && atomic64_read(&oled->frame_completed) < seq)
+        ret = -ENODEV;
+    return ret;
 }
 
-
-void OLED_Display_Off(void)
+// Replace the completion eventfd, a negative fd removes it
+static long oled_set_eventfd(struct oled_sh1106 *oled, unsigned long arg)
 {
-	OLED_SH1106_Write(true,0X8D);  //SET DCDC command
-	OLED_SH1106_Write(true,0X10);  //DCDC OFF
-	OLED_SH1106_Write(true,0XAE);  //DISPLAY OFF
-}
+    struct eventfd_ctx *ctx = NULL;
+    __s32 fd;
 
+    if (copy_from_user(&fd, (__s32 __user *)arg, sizeof(fd)))
+        return -EFAULT;
+    if (fd >= 0)
+    {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+    }
+    if (oled->eventfd)
+        eventfd_ctx_put(oled->eventfd);
+    oled->eventfd = ctx;
+    return 0;
+}
 
-int OLED_SH1106_DisplayInit(void)
+// Read function, returns the completed frame count once nothing is in flight
+static ssize_t oled_read(struct file *filep, char __user *buf, size_t count, loff_t *ppos)
 {
-  int ret = 0;
-  
-  //Initialize the Reset and DC GPIOs
-  ret = OLED_sh1106_ResetDcInit();
-  
-  if( ret >= 0 )
-  {
-    //Make the RESET Line to 0
-    OLED_SH1106_setRst( 0u );
-    msleep(100);                          // delay
-    //Make the DC Line to 1
-    OLED_SH1106_setRst( 1u );
-    msleep(100);                          // delay
-    
-    /*
-    ** Commands to initialize the SSD_1306 OLED Display
-    */
-    OLED_SH1106_Write(true,0X8D);  //SET DCDC command
-    OLED_SH1106_Write(true,0X10);  //DCDC OFF
-    OLED_SH1106_Write(true,0XAE); 
-    OLED_SH1106_Write(true, 0xAE); // Entire Display OFF
-    OLED_SH1106_Write(true, 0x02); // Set Display Clock Divide Ratio and Oscillator Frequency
+    struct oled_sh1106 *oled = filep->private_data;
+    u64 seq;
+    int ret;
+
+    if (count < sizeof(seq))
+        return -EINVAL;
+    if (filep->f_flags & O_NONBLOCK)
+    {
+        if (READ_ONCE(oled->removed))
+            return -ENODEV;
+        if (oled_frame_busy(oled))
+            return -EAGAIN;
+    }
+    else
+    {
+        ret = wait_event_interruptible(oled->frame_wait,
+                                       !oled_frame_busy(oled) || READ_ONCE(oled->removed));
+        if (ret)
+            return ret;
+        if (oled_frame_busy(oled))
+            return -ENODEV;
+    }
 
-    OLED_SH1106_Write(true, 0x10); // Default Setting for Display Clock Divide Ratio and Oscillator Frequency that is recommended
-    OLED_SH1106_Write(true, 0x40); // Set Multiplex Ratio
+    seq = atomic64_read(&oled->frame_completed);
+    if (copy_to_user(buf, &seq, sizeof(seq)))
+        return -EFAULT;
+    return sizeof(seq);
+}
+
+// Poll function, readable while no frame is in flight, writable while drawing would not wait
+static __poll_t oled_poll(struct file *filep, poll_table *wait)
+{
+    struct oled_sh1106 *oled = filep->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(filep, &oled->frame_wait, wait);
+    if (READ_ONCE(oled->removed))
+        return EPOLLHUP | EPOLLERR;
+    if (!oled_frame_busy(oled))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (!oled_queue_full(oled))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
+}
+
+// Merge a linear image into the framebuffer, called with the framebuffer lock held
+static long oled_update_rect(struct oled_sh1106 *oled, unsigned long arg)
+{
+    struct oled_image img;
+    size_t stride, len;
+    u8 *data;
+
+    if (copy_from_user(&img, (struct oled_image __user *)arg, sizeof(img)))
+        return -EFAULT;
+    if (img.rop > OLED_ROP_XOR)
+        return -EINVAL;
+
+    stride = img.stride ? img.stride : (img.w + 7) / 8;
+    if (stride < (img.w + 7) / 8)
+        return -EINVAL;
+    len = stride * img.h;
+    if (len > OLED_IMAGE_MAX_DATA)
+        return -E2BIG;
+    if (!len)
+        return 0;
+
+    data = memdup_user(u64_to_user_ptr(img.data), len);
+    if (IS_ERR(data))
+        return PTR_ERR(data);
+
+    OLED_SH1106_Image(&oled->panel, img.x, img.y, img.w, img.h, data, stride, img.rop);
+    kfree(data);
+    return 0;
+}
+
+// Convert a grayscale or XRGB8888 rectangle, called with the framebuffer lock held
+static long oled_update_pixels(struct oled_sh1106 *oled, unsigned long arg)
+{
+    struct oled_pixels px;
+    size_t row, stride;
+    long ret = 0;
+    u8 *data;
+    u32 r;
+
+    if (copy_from_user(&px, (struct oled_pixels __user *)arg, sizeof(px)))
+        return -EFAULT;
+    if (px.format > OLED_PIXEL_XRGB8888 || px.dither > OLED_DITHER_FLOYD_STEINBERG ||
+        px.w > OLED_SH1106_WIDTH || px.h > OLED_SH1106_HEIGHT)
+        return -EINVAL;
+
+    row = px.w * (px.format == OLED_PIXEL_XRGB8888 ? 4 : 1);
+    stride = px.stride ? px.stride : row;
+    if (stride < row)
+        return -EINVAL;
+    if (!row || !px.h)
+        return 0;
+
+    // the rows may lie in a much larger surface, only the rectangle is copied
+    data = kvmalloc_array(px.h, row, GFP_KERNEL);
+    if (!data)
+        return -ENOMEM;
+    for (r = 0; r < px.h; r++)
+    {
+        if (copy_from_user(data + r * row, u64_to_user_ptr(px.data + r * stride), row))
+        {
+            ret = -EFAULT;
+            goto out;
+        }
+    }
+    OLED_SH1106_Pixels(&oled->panel, px.x, px.y, px.w, px.h, data, row, px.format, px.dither, px.level);
+out:
+    kvfree(data);
+    return ret;
+}
+
+// Decode a compressed frame, called with the framebuffer lock held
+static long oled_upload(struct oled_sh1106 *oled, unsigned long arg)
+{
+    struct oled_upload up;
+    u8 *data;
+    long ret;
+
+    if (copy_from_user(&up, (struct oled_upload __user *)arg, sizeof(up)))
+        return -EFAULT;
+    if (up.len > OLED_UPLOAD_MAX_DATA)
+        return -E2BIG;
+    if (up.format > OLED_UPLOAD_XOR)
+        return -EINVAL;
+
+    data = memdup_user(u64_to_user_ptr(up.data), up.len);
+    if (IS_ERR(data))
+        return PTR_ERR(data);
+
+    ret = OLED_SH1106_Upload(&oled->panel, data, up.len, up.format);
+    kfree(data);
+    return ret;
+}
 
-    OLED_SH1106_Write(true, 0x81); // 64 COM lines
+/*
+** Put a font into a loadable slot, or empty the slot if len is 0. The
+** font is parsed from its own copy of data. Called with the framebuffer
+** lock held, or before the device is visible.
+*/
+static int oled_font_set(struct oled_sh1106 *oled, u32 slot, const u8 *data, size_t len)
+{
+    struct sh1106_font *font = NULL;
+    int ret;
 
-    OLED_SH1106_Write(true, 0xCF); // Set display offset
-    OLED_SH1106_Write(true, 0xA1); // 0 offset
+    if (slot < OLED_FONT_FIRST_LOADABLE || slot >= OLED_FONT_SLOTS)
+        return -EINVAL;
+    if (len > OLED_FONT_MAX_DATA)
+        return -E2BIG;
 
-    OLED_SH1106_Write(true, 0xC8); // Set first line as the start line of the display
+    if (len)
+    {
+        font = kvmalloc(sizeof(*font) + len, GFP_KERNEL);
+        if (!font)
+            return -ENOMEM;
+        memcpy(font + 1, data, len);
+        ret = OLED_SH1106_FontParse(font, (const u8 *)(font + 1), len);
+        if (ret)
+        {
+            kvfree(font);
+            return ret;
+        }
+    }
 
-    OLED_SH1106_Write(true, 0xA6); // Charge pump
-    OLED_SH1106_Write(true, 0xA8); // Enable charge dump during display on
+    kvfree(oled->panel.fonts[slot]);
+    oled->panel.fonts[slot] = font;
+    if (!font && oled->panel.font == slot)
+        oled->panel.font = OLED_FONT_5X7;
+    return 0;
+}
 
-    OLED_SH1106_Write(true, 0x3F); // Set memory addressing mode
-    OLED_SH1106_Write(true, 0xD3); // Horizontal addressing mode
+// Load a font from userspace, called with the framebuffer lock held
+static long oled_font_load(struct oled_sh1106 *oled, unsigned long arg)
+{
+    struct oled_font_load load;
+    u8 *data;
+    long ret;
+
+    if (copy_from_user(&load, (struct oled_font_load __user *)arg, sizeof(load)))
+        return -EFAULT;
+    if (load.len > OLED_FONT_MAX_DATA)
+        return -E2BIG;
+
+    data = vmemdup_user(u64_to_user_ptr(load.data), load.len);
+    if (IS_ERR(data))
+        return PTR_ERR(data);
+
+    ret = oled_font_set(oled, load.slot, data, load.len);
+    kvfree(data);
+    return ret;
+}
 
-    OLED_SH1106_Write(true, 0x00); // Set segment remap with column address 127 mapped to segment 0
+// Fill the loadable font slots from the firmware files that exist
+static void oled_font_firmware(struct oled_sh1106 *oled)
+{
+    const struct firmware *fw;
+    char name[24];
+    u32 slot;
 
-    OLED_SH1106_Write(true, 0xD5); // Set com output scan direction, scan from com63 to com 0
+    for (slot = OLED_FONT_FIRST_LOADABLE; slot < OLED_FONT_SLOTS; slot++)
+    {
+        snprintf(name, sizeof(name), "sh1106-font%u.bin", slot);
+        if (firmware_request_nowarn(&fw, name, oled->parent))
+            continue;
+        if (oled_font_set(oled, slot, fw->data, fw->size))
+            dev_warn(oled->parent, "Ignoring malformed font %s\n", name);
+        release_firmware(fw);
+    }
+}
 
-    OLED_SH1106_Write(true, 0x80); // Set com pins hardware configuration
-    OLED_SH1106_Write(true, 0xD9); // Alternative com pin configuration, disable com left/right remap
+// Apply one display list operation, called with the framebuffer lock held
+static int oled_dl_apply(struct oled_sh1106 *oled, const struct oled_dl_op *op, char *buf)
+{
+    if (op->len > OLED_DL_MAX_DATA)
+        return -E2BIG;
+    if (op->reserved[0] || op->reserved[1])
+        return -EINVAL;
+    if (op->op >= OLED_OP_PIXEL && op->op <= OLED_OP_FILL_CIRCLE && op->value > OLED_COLOR_INVERT)
+        return -EINVAL;
+
+    switch (op->op)
+    {
+        case OLED_OP_CURSOR:
+            OLED_SH1106_SetCursor(&oled->panel, op->y, op->x);
+            break;
+        case OLED_OP_TEXT:
+            if (copy_from_user(buf, u64_to_user_ptr(op->data), op->len))
+                return -EFAULT;
+            OLED_SH1106_Text(&oled->panel, buf, op->len);
+            break;
+        case OLED_OP_FILL:
+            OLED_SH1106_fill(&oled->panel, op->value);
+            break;
+        case OLED_OP_INVERT:
+            OLED_SH1106_InvertDisplay(&oled->panel, op->value != 0);
+            break;
+        case OLED_OP_BRIGHTNESS:
+            OLED_SH1106_SetBrightness(&oled->panel, op->value);
+            break;
+        case OLED_OP_BLIT:
+            if (op->w <= 0 || op->h <= 0 || op->rop > OLED_ROP_XOR ||
+                op->len != op->w * ((op->h + 7) / 8))
+                return -EINVAL;
+            if (copy_from_user(buf, u64_to_user_ptr(op->data), op->len))
+                return -EFAULT;
+            OLED_SH1106_BlitRop(&oled->panel, op->x, op->y, op->w, op->h, (const uint8_t *)buf,
+                                op->rop);
+            break;
+        case OLED_OP_IMAGE:
+            if (op->w <= 0 || op->h <= 0 || op->rop > OLED_ROP_XOR ||
+                op->len != ((op->w + 7) / 8) * op->h)
+                return -EINVAL;
+            if (copy_from_user(buf, u64_to_user_ptr(op->data), op->len))
+                return -EFAULT;
+            OLED_SH1106_Image(&oled->panel, op->x, op->y, op->w, op->h, (const uint8_t *)buf,
+                              (op->w + 7) / 8, op->rop);
+            break;
+        case OLED_OP_CLEAR:
+            OLED_SH1106_ClearDisplay(&oled->panel);
+            break;
+        case OLED_OP_SCROLL:
+            OLED_SH1106_Scroll(&oled->panel, op->y);
+            break;
+        case OLED_OP_PIXEL:
+            OLED_SH1106_DrawPixel(&oled->panel, op->x, op->y, op->value);
+            break;
+        case OLED_OP_LINE:
+            OLED_SH1106_DrawLine(&oled->panel, op->x, op->y, op->x + op->w, op->y + op->h, op->value);
+            break;
+        case OLED_OP_RECT:
+            OLED_SH1106_DrawRect(&oled->panel, op->x, op->y, op->w, op->h, op->value);
+            break;
+        case OLED_OP_FILL_RECT:
+            OLED_SH1106_FillRect(&oled->panel, op->x, op->y, op->w, op->h, op->value);
+            break;
+        case OLED_OP_CIRCLE:
+            OLED_SH1106_DrawCircle(&oled->panel, op->x, op->y, op->w, op->value);
+            break;
+        case OLED_OP_FILL_CIRCLE:
+            OLED_SH1106_FillCircle(&oled->panel, op->x, op->y, op->w, op->value);
+            break;
+        case OLED_OP_FONT:
+            return OLED_SH1106_SetFont(&oled->panel, op->value);
+        default:
+            return -EINVAL;
+    }
+    return 0;
+}
 
-    OLED_SH1106_Write(true, 0xF1); // Set contrast control
-    OLED_SH1106_Write(true, 0xDA); // Set Contrast to 128
+// Run a display list, called with the framebuffer lock held
+static long oled_display_list(struct oled_sh1106 *oled, unsigned long arg)
+{
+    struct oled_display_list dl;
+    struct oled_dl_op *ops;
+    char *buf;
+    long ret = 0;
+    u32 i;
+
+    if (copy_from_user(&dl, (struct oled_display_list __user *)arg, sizeof(dl)))
+        return -EFAULT;
+    if (dl.count == 0)
+        return 0;
+    if (dl.count > OLED_DL_MAX_OPS)
+        return -E2BIG;
+
+    ops = memdup_user(u64_to_user_ptr(dl.ops), array_size(dl.count, sizeof(*ops)));
+    if (IS_ERR(ops))
+        return PTR_ERR(ops);
+
+    buf = kmalloc(OLED_DL_MAX_DATA, GFP_KERNEL);
+    if (!buf)
+    {
+        kfree(ops);
+        return -ENOMEM;
+    }
 
-    OLED_SH1106_Write(true, 0x12); // Set pre-charge period
-    OLED_SH1106_Write(true, 0xDB); // Phase 1 period of 15 DCLK, Phase 2 period of 1 DCLK
+    for (i = 0; i < dl.count && ret == 0; i++)
+        ret = oled_dl_apply(oled, &ops[i], buf);
 
-    OLED_SH1106_Write(true, 0x40); // Set Vcomh deselect level
-    OLED_SH1106_Write(true, 0x20); // Vcomh deselect level ~ 0.77 Vcc
+    kfree(buf);
+    kfree(ops);
+    return ret;
+}
 
-    OLED_SH1106_Write(true, 0x02); // Entire display ON, resume to RAM content display
-    OLED_SH1106_Write(true, 0x8D); // Set Display in Normal Mode, 1 = ON, 0 = OFF
+// Commands that only read or set driver state, called with the framebuffer lock held.
+// They neither wake the panel nor flush, so a status poller does not keep it awake.
+static long oled_state_ioctl(struct oled_sh1106 *oled, unsigned int cmd, unsigned long arg)
+{
+    struct oled_frame_seq seq;
 
-    OLED_SH1106_Write(true, 0x14); // Deactivate scroll
+    switch (cmd)
+    {
+        case IOCTL_FRAME_SEQ:
+            seq.completed = atomic64_read(&oled->frame_completed);
+            seq.submitted = atomic64_read(&oled->frame_submitted);
+            if (copy_to_user((struct oled_frame_seq __user *)arg, &seq, sizeof(seq)))
+                return -EFAULT;
+            return 0;
+        case IOCTL_SET_EVENTFD:
+            return oled_set_eventfd(oled, arg);
+        case IOCTL_SET_QUEUE:
+            return oled_queue_set(oled, arg);
+        case IOCTL_GET_QUEUE:
+            return oled_queue_get(oled, arg);
+        default:
+            return -ENOIOCTLCMD;
+    }
+}
 
-    OLED_SH1106_Write(true, 0xA4); // Display ON in normal mode
-    OLED_SH1106_Write(true, 0xA6);
-    OLED_SH1106_Write(true, 0xAF);
-    
-    
-    OLED_SH1106_Write(true,0X8D);  //SET DCDC command
-    OLED_SH1106_Write(true,0X14);  //DCDC ON
-    OLED_SH1106_Write(true,0XAF);
-    
-    // Clear the display
-    OLED_Clear(0x00);
+// Commands that draw or drive the panel, they run under runtime PM and end with a flush
+static bool oled_panel_ioctl(unsigned int cmd)
+{
+    switch (cmd)
+    {
+        case IOCTL_INIT_DISPLAY:
+        case IOCTL_DEINIT_DISPLAY:
+        case IOCTL_SET_CURSOR:
+        case IOCTL_NEXT_LINE:
+        case IOCTL_PRINT_CHAR:
+        case IOCTL_PRINT_STRING:
+        case IOCTL_INVERT_DISPLAY:
+        case IOCTL_SET_BRIGHTNESS:
+        case IOCTL_FILL_DISPLAY:
+        case IOCTL_CLEAR_DISPLAY:
+        case IOCTL_PRINT_LOGO:
+        case IOCTL_FLUSH:
+        case IOCTL_DISPLAY_LIST:
+        case IOCTL_SCROLL_VERTICAL:
+        case IOCTL_DEACTIVATE_SCROLL:
+        case IOCTL_CONSOLE_VIEW:
+        case IOCTL_SET_FONT:
+        case IOCTL_LOAD_FONT:
+        case IOCTL_UPDATE_RECT:
+        case IOCTL_UPDATE_PIXELS:
+        case IOCTL_UPLOAD:
+        case IOCTL_ANIM_LOAD:
+        case IOCTL_ANIM_PLAY:
+            return true;
+        default:
+            return false;
+    }
+}
 
-  }
-    
-  return( ret );
+// IOCTL function
+static long oled_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+    struct oled_sh1106 *oled = filep->private_data;
+    struct cursor_pos cursor;
+    struct oled_rect rect;
+    unsigned char c;
+    bool invert;
+    uint8_t value;
+    __s32 rows;
+    u32 slot;
+    long ret = 0;
+
+    // these block, so they must not hold the lock
+    if (cmd == IOCTL_ANIM_WAIT)
+        return oled_anim_wait(oled);
+    if (cmd == IOCTL_WAIT_FRAME)
+        return oled_frame_wait(oled, arg);
+
+    mutex_lock(&oled->lock);
+    if (oled->removed)
+    {
+        mutex_unlock(&oled->lock);
+        return -ENODEV;
+    }
+    ret = oled_state_ioctl(oled, cmd, arg);
+    if (ret != -ENOIOCTLCMD)
+    {
+        mutex_unlock(&oled->lock);
+        return ret;
+    }
+    // unknown commands neither wait for the queue nor wake the panel
+    if (!oled_panel_ioctl(cmd))
+    {
+        mutex_unlock(&oled->lock);
+        return -ENOTTY;
+    }
+    ret = oled_queue_wait(oled, filep);
+    if (ret)
+    {
+        mutex_unlock(&oled->lock);
+        return ret;
+    }
+    ret = oled_pm_get(oled);
+    if (ret < 0)
+    {
+        mutex_unlock(&oled->lock);
+        return ret;
+    }
+    switch (cmd)
+    {
+        case IOCTL_INIT_DISPLAY:
+            ret = OLED_SH1106_DisplayInit(&oled->panel);
+            dev_dbg(oled->dev, "initialized: %ld\n", ret);
+            break;
+        case IOCTL_DEINIT_DISPLAY:
+            OLED_SH1106_DisplayDeInit(&oled->panel);
+            dev_dbg(oled->dev, "deinitialized\n");
+            break;
+        case IOCTL_SET_CURSOR:
+            if (copy_from_user(&cursor, (struct cursor_pos __user *)arg, sizeof(cursor)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_SetCursor(&oled->panel, cursor.line_no, cursor.cursor_pos);
+            dev_dbg(oled->dev, "cursor set to line %d, position %d\n", cursor.line_no, cursor.cursor_pos);
+            break;
+        case IOCTL_NEXT_LINE:
+            OLED_SH1106_GoToNextLine(&oled->panel);
+            dev_dbg(oled->dev, "cursor moved to next line\n");
+            break;
+        case IOCTL_PRINT_CHAR:
+            if (copy_from_user(&c, (unsigned char __user *)arg, sizeof(c)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_PrintChar(&oled->panel, c);
+            dev_dbg(oled->dev, "printed character %c\n", c);
+            break;
+        case IOCTL_PRINT_STRING:
+            ret = oled_print_string(oled, (const char __user *)arg);
+            dev_dbg(oled->dev, "printed string\n");
+            break;
+        case IOCTL_INVERT_DISPLAY:
+            if (copy_from_user(&invert, (bool __user *)arg, sizeof(invert)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_InvertDisplay(&oled->panel, invert);
+            dev_dbg(oled->dev, "inverted display: %d\n", invert);
+            break;
+        case IOCTL_SET_BRIGHTNESS:
+            if (copy_from_user(&value, (uint8_t __user *)arg, sizeof(value)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_SetBrightness(&oled->panel, value);
+            dev_dbg(oled->dev, "set brightness to %d\n", value);
+            break;
+
+        case IOCTL_FILL_DISPLAY:
+            if (copy_from_user(&value, (uint8_t __user *)arg, sizeof(value)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_fill(&oled->panel, value);
+            dev_dbg(oled->dev, "filled display with 0x%x\n", value);
+            break;
+        case IOCTL_CLEAR_DISPLAY:
+            OLED_Clear(&oled->panel, 0x00);
+            dev_dbg(oled->dev, "cleared display\n");
+            break;
+        case IOCTL_PRINT_LOGO:
+            OLED_SH1106_PrintLogo(&oled->panel);
+            dev_dbg(oled->dev, "printed logo\n");
+            break;
+        case IOCTL_FLUSH:
+            if (copy_from_user(&rect, (struct oled_rect __user *)arg, sizeof(rect)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_MarkRect(&oled->panel, rect.x, rect.y, rect.width, rect.height);
+            break;
+        case IOCTL_DISPLAY_LIST:
+            ret = oled_display_list(oled, arg);
+            break;
+        case IOCTL_SCROLL_VERTICAL:
+            if (copy_from_user(&rows, (__s32 __user *)arg, sizeof(rows)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_Scroll(&oled->panel, rows);
+            break;
+        case IOCTL_DEACTIVATE_SCROLL:
+            OLED_SH1106_ResetScroll(&oled->panel);
+            break;
+        case IOCTL_CONSOLE_VIEW:
+            if (copy_from_user(&rows, (__s32 __user *)arg, sizeof(rows)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            OLED_SH1106_ConsoleView(&oled->panel, rows);
+            break;
+        case IOCTL_SET_FONT:
+            if (copy_from_user(&slot, (u32 __user *)arg, sizeof(slot)))
+            {
+                ret = -EFAULT;
+                break;
+            }
+            ret = OLED_SH1106_SetFont(&oled->panel, slot);
+            break;
+        case IOCTL_LOAD_FONT:
+            ret = oled_font_load(oled, arg);
+            break;
+        case IOCTL_UPDATE_RECT:
+            ret = oled_update_rect(oled, arg);
+            break;
+        case IOCTL_UPDATE_PIXELS:
+            ret = oled_update_pixels(oled, arg);
+            break;
+        case IOCTL_UPLOAD:
+            ret = oled_upload(oled, arg);
+            break;
+        case IOCTL_ANIM_LOAD:
+            ret = oled_anim_load(oled, arg);
+            break;
+        case IOCTL_ANIM_PLAY:
+            ret = oled_anim_play(oled, arg);
+            break;
+        default:
+            ret = -ENOTTY;
+            break;
+    }
+    // Queue whatever the command changed in the shadow framebuffer,
+    // including the operations of a display list that ran before an error
+    OLED_SH1106_Flush(&oled->panel);
+    oled_pm_put(oled);
+    mutex_unlock(&oled->lock);
+    return ret;
+}
+
+// debugfs stats file
+static int oled_stats_show(struct seq_file *m, void *v)
+{
+    struct oled_sh1106 *oled = m->private;
+    struct sh1106_stats st;
+    int i;
+
+    mutex_lock(&oled->lock);
+    mutex_lock(&oled->bus_lock);
+    st = oled->panel.stats;
+    mutex_unlock(&oled->bus_lock);
+    mutex_unlock(&oled->lock);
+
+    seq_printf(m, "transfers: %llu\n", st.transfers);
+    seq_printf(m, "bytes: %llu\n", st.cmd_bytes + st.data_bytes);
+    seq_printf(m, "cmd_bytes: %llu\n", st.cmd_bytes);
+    seq_printf(m, "data_bytes: %llu\n", st.data_bytes);
+    seq_printf(m, "dc_toggles: %llu\n", st.dc_toggles);
+    seq_printf(m, "errors: %llu\n", st.errors);
+    seq_printf(m, "flush_requests: %llu\n", st.requests);
+    seq_printf(m, "coalesced: %llu\n", st.coalesced);
+    seq_printf(m, "queue_dropped: %llu\n", st.queue_dropped);
+    seq_printf(m, "flushes: %llu\n", st.flushes);
+    seq_printf(m, "dropped: %llu\n", st.dropped);
+    seq_printf(m, "bridged: %llu\n", st.bridged);
+    seq_printf(m, "latency_avg_us: %llu\n", st.flushes ? div64_u64(st.lat_total_us, st.flushes) : 0);
+    seq_printf(m, "latency_max_us: %llu\n", st.lat_max_us);
+    seq_puts(m, "latency_hist_us:\n");
+    for (i = 0; i < OLED_LAT_BUCKETS; i++)
+    {
+        if (i == 0)
+            seq_printf(m, "  <1: %llu\n", st.lat_hist[i]);
+        else if (i == OLED_LAT_BUCKETS - 1)
+            seq_printf(m, "  >=%lu: %llu\n", 1UL << (i - 1), st.lat_hist[i]);
+        else
+            seq_printf(m, "  %lu-%lu: %llu\n", 1UL << (i - 1), (1UL << i) - 1, st.lat_hist[i]);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(oled_stats);
+
+// Free the per-device state once the last reference is gone
+static void oled_free_dev(struct kref *ref)
+{
+    struct oled_sh1106 *oled = container_of(ref, struct oled_sh1106, ref);
+    unsigned int slot;
+
+    if (oled->wq)
+        destroy_workqueue(oled->wq);
+    if (oled->eventfd)
+        eventfd_ctx_put(oled->eventfd);
+    while (oled->queue_alloc)
+        kfree(oled->queue[--oled->queue_alloc]);
+    kvfree(oled->anim_data);
+    for (slot = OLED_FONT_FIRST_LOADABLE; slot < OLED_FONT_SLOTS; slot++)
+        kvfree(oled->panel.fonts[slot]);
+    kfree(oled->panel.con_text);
+    kfree(oled->panel.shown);
+    kfree(oled->panel.front);
+    free_page((unsigned long)oled->panel.fb);
+    if (oled->minor >= 0)
+        ida_free(&oled_minors, oled->minor);
+    kfree(oled);
+}
+
+// Release of the device node, the cdev parented to it lets go last
+static void oled_release_dev(struct device *dev)
+{
+    struct oled_sh1106 *oled = container_of(dev, struct oled_sh1106, device);
+
+    kref_put(&oled->ref, oled_free_dev);
+}
+
+// SPI write function, buf must be DMA-safe (kmalloc'ed, not on the stack)
+static int oled_spi_write(void *ctx, const u8 *buf, size_t len, bool data)
+{
+    // the SH1106 is write-only so there is no rx buffer
+    struct spi_transfer tr = {
+        .tx_buf = buf,
+        .len = len,
+    };
+    struct spi_message msg;
+
+    spi_message_init(&msg);
+    spi_message_add_tail(&tr, &msg);
+    // the whole buffer goes out as one message
+    return spi_sync(ctx, &msg);
+}
+
+static const struct oled_bus oled_spi_bus = {
+    .name = "SPI",
+    .dc_gpio = true,
+    .write = oled_spi_write,
+};
+
+// Send a run of bytes through the backend, called with bus_lock held
+static int oled_bus_write(struct sh1106_panel *panel, const uint8_t *buf, size_t len)
+{
+    struct oled_sh1106 *oled = to_oled(panel);
+    bool is_cmd = (panel->dc_state == 0);
+    ktime_t start;
+    int ret;
+
+    trace_sh1106_xfer_submit(oled->minor, is_cmd, len);
+    start = ktime_get();
+    ret = oled->bus->write(oled->bus_ctx, buf, len, !is_cmd);
+    trace_sh1106_xfer_done(oled->minor, is_cmd, len, ret, ktime_to_ns(ktime_sub(ktime_get(), start)));
+    return ret;
+}
+
+static void oled_set_dc(struct sh1106_panel *panel, int value)
+{
+    gpiod_set_value_cansleep(to_oled(panel)->dc, value);
+}
+
+// logical level, 1 holds the controller in reset
+static void oled_set_reset(struct sh1106_panel *panel, int value)
+{
+    gpiod_set_value_cansleep(to_oled(panel)->reset, value);
+}
+
+static void oled_delay_us(struct sh1106_panel *panel, unsigned int us)
+{
+    fsleep(us);
+}
+
+// Submit a frame to the queue of the flush worker, called with the framebuffer lock held
+static void oled_queue_flush(struct sh1106_panel *panel)
+{
+    struct oled_sh1106 *oled = to_oled(panel);
+    struct sh1106_frame plan;
+    struct oled_qframe *f;
+    u32 waiting = oled_queue_waiting(oled);
+
+    panel->xfer_cost = READ_ONCE(xfer_cost);
+    OLED_SH1106_Snapshot(panel, &plan);
+
+    if (waiting >= oled->queue_depth && oled->queue_policy == OLED_QUEUE_DROP_OLDEST && waiting > 1)
+    {
+        oled_queue_drop_oldest(oled);
+        waiting--;
+    }
+    if (waiting < oled->queue_depth)
+    {
+        f = oled->queue[oled->queue_len++];
+        f->plan = plan;
+        f->queued = ktime_get();
+        queue_work(oled->wq, &oled->flush_work);
+        panel->stats.requests++;
+    }
+    else
+    {
+        // OLED_QUEUE_DROP_OLDEST gets here at depth 1 only, a full queue
+        // under OLED_QUEUE_BLOCK only from the animation player
+        f = oled->queue[oled->queue_len - 1];
+        oled_queue_merge(f->plan.cols, plan.cols);
+        f->plan.start_line = plan.start_line;
+        panel->stats.coalesced++;
+    }
+    memcpy(f->data, panel->front, sizeof(f->data));
+    f->plan.data = f->data;
+    f->seq = atomic64_inc_return(&oled->frame_submitted);
 }
 
+static void oled_bus_lock(struct sh1106_panel *panel)
+{
+    mutex_lock(&to_oled(panel)->bus_lock);
+}
 
-void OLED_SH1106_DisplayDeInit(void)
+static void oled_bus_unlock(struct sh1106_panel *panel)
 {
-  OLED_SH1106_ResetDcDeInit();  //Free the Reset and DC GPIO
+    mutex_unlock(&to_oled(panel)->bus_lock);
+}
+
+static const struct sh1106_bus_ops oled_bus_ops = {
+    .write = oled_bus_write,
+    .set_dc = oled_set_dc,
+    .set_reset = oled_set_reset,
+    .delay_us = oled_delay_us,
+    .flush = oled_queue_flush,
+    .lock = oled_bus_lock,
+    .unlock = oled_bus_unlock,
+};
+
+// Allocate the per-device state with its framebuffers and flush worker
+static struct oled_sh1106 *oled_alloc_dev(void)
+{
+    struct oled_sh1106 *oled;
+
+    oled = kzalloc(sizeof(*oled), GFP_KERNEL);
+    if (!oled)
+        return NULL;
+
+    kref_init(&oled->ref);
+    oled->minor = ida_alloc_max(&oled_minors, OLED_MAX_DEVICES - 1, GFP_KERNEL);
+    oled->panel.fb = (void *)get_zeroed_page(GFP_KERNEL);
+    oled->panel.front = kzalloc(OLED_SH1106_FB_SIZE, GFP_KERNEL);
+    oled->panel.shown = kzalloc(OLED_SH1106_FB_SIZE, GFP_KERNEL);
+    oled->panel.con_text = kmalloc_array(SH1106_CON_LINES, SH1106_CON_COLS, GFP_KERNEL);
+    // depth 1: a frame on the bus and one that takes the changes meanwhile
+    oled->queue_depth = 1;
+    oled->queue_policy = OLED_QUEUE_COALESCE;
+    for (; oled->queue_alloc < 2; oled->queue_alloc++)
+    {
+        oled->queue[oled->queue_alloc] = kmalloc(sizeof(struct oled_qframe), GFP_KERNEL);
+        if (!oled->queue[oled->queue_alloc])
+            break;
+    }
+    if (oled->minor >= 0)
+        oled->wq = alloc_ordered_workqueue("%s%d", 0, DEVICE_NAME, oled->minor);
+    if (oled->minor < 0 || !oled->panel.fb || !oled->panel.front || !oled->panel.shown || !oled->panel.con_text ||
+        oled->queue_alloc < 2 || !oled->wq)
+    {
+        kref_put(&oled->ref, oled_free_dev);
+        return NULL;
+    }
+
+    mutex_init(&oled->lock);
+    mutex_init(&oled->bus_lock);
+    INIT_WORK(&oled->flush_work, OLED_SH1106_FlushWork);
+    INIT_WORK(&oled->anim_work, oled_anim_work);
+    init_waitqueue_head(&oled->anim_wait);
+    init_waitqueue_head(&oled->frame_wait);
+    hrtimer_init(&oled->anim_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    oled->anim_timer.function = oled_anim_tick;
+    OLED_SH1106_InitPanel(&oled->panel, &oled_bus_ops);
+    return oled;
+}
+
+/*
+** Get the reset and DC lines from the "reset-gpios" and "dc-gpios"
+** properties. Device trees without "dc-gpios" fall back to the fixed
+** SH1106_RST_PIN/SH1106_DC_PIN pins, which only one panel can use.
+**
+** I2C panels have no DC line and need no fallback, their reset line is
+** optional.
+**
+** With keep_panel, a reset line that is still driven inactive was left
+** so by the previous driver instance; the panel is then configured and
+** the first init skips the reset. After power up the line is an input.
+*/
+static int oled_get_gpios(struct oled_sh1106 *oled)
+{
+    struct device *dev = oled->parent;
+    int ret;
+
+    if (oled->bus->dc_gpio)
+    {
+        oled->dc = devm_gpiod_get_optional(dev, "dc", GPIOD_OUT_HIGH);
+        if (IS_ERR(oled->dc))
+            return PTR_ERR(oled->dc);
+    }
+
+    if (oled->dc || !oled->bus->dc_gpio)
+    {
+        oled->reset = devm_gpiod_get_optional(dev, "reset", GPIOD_ASIS);
+        if (IS_ERR_OR_NULL(oled->reset))
+            return PTR_ERR_OR_ZERO(oled->reset);
+
+        oled->panel.warm = keep_panel && gpiod_get_direction(oled->reset) == 0 &&
+                           gpiod_get_value_cansleep(oled->reset) == 0;
+        return gpiod_direction_output(oled->reset, 0);
+    }
+
+    ret = devm_gpio_request_one(dev, SH1106_DC_PIN, GPIOF_OUT_INIT_HIGH, "SH1106_DC_PIN");
+    if (ret)
+        return ret;
+    ret = devm_gpio_request_one(dev, SH1106_RST_PIN, GPIOF_OUT_INIT_HIGH, "SH1106_RST_PIN");
+    if (ret)
+        return ret;
+
+    oled->dc = gpio_to_desc(SH1106_DC_PIN);
+    oled->reset = gpio_to_desc(SH1106_RST_PIN);
+    // the legacy reset pin is active low like the usual "reset-gpios" binding
+    gpiod_toggle_active_low(oled->reset);
+    return 0;
 }
 
+/*
+** Set up a panel found by a bus backend: the per-device state, GPIOs,
+** fonts, power management and the device node. ctx is handed back to
+** bus->write().
+*/
+int oled_probe_bus(struct device *parent, const struct oled_bus *bus, void *ctx)
+{
+    struct oled_sh1106 *oled;
+    int ret;
+
+    oled = oled_alloc_dev();
+    if (!oled)
+        return -ENOMEM;
+    oled->parent = parent;
+    oled->bus = bus;
+    oled->bus_ctx = ctx;
+
+    ret = oled_get_gpios(oled);
+    if (ret)
+    {
+        dev_err(parent, "Failed to get reset/DC GPIOs: %d\n", ret);
+        goto err_put;
+    }
+
+    // Reset timing, the core defaults follow the datasheet
+    of_property_read_u32(parent->of_node, "reset-assert-us", &oled->panel.reset_assert_us);
+    of_property_read_u32(parent->of_node, "reset-deassert-us", &oled->panel.reset_deassert_us);
+
+    oled_font_firmware(oled);
+    dev_set_drvdata(parent, oled);
+
+    // Active until the first autosuspend, enabled once the device node exists
+    pm_runtime_set_autosuspend_delay(parent, autosuspend_ms);
+    pm_runtime_use_autosuspend(parent);
+    pm_runtime_set_active(parent);
+
+    // The device node owns a reference, so the state outlives every opener of the cdev
+    device_initialize(&oled->device);
+    oled->device.class = oled_class;
+    oled->device.parent = parent;
+    oled->device.devt = MKDEV(MAJOR(oled_devt), oled->minor);
+    oled->device.release = oled_release_dev;
+    dev_set_drvdata(&oled->device, oled);
+    kref_get(&oled->ref);
+    ret = dev_set_name(&oled->device, DEVICE_NAME "%d", oled->minor);
+    if (ret)
+        goto err_device;
+
+    cdev_init(&oled->cdev, &fops);
+    oled->cdev.owner = THIS_MODULE;
+    ret = cdev_device_add(&oled->cdev, &oled->device);
+    if (ret)
+    {
+        dev_err(parent, "Failed to add char device\n");
+        goto err_device;
+    }
+    oled->dev = &oled->device;
+
+    oled->debugfs = debugfs_create_dir(dev_name(oled->dev), NULL);
+    debugfs_create_file("stats", 0444, oled->debugfs, oled, &oled_stats_fops);
+    pm_runtime_enable(parent);
 
+    dev_info(parent, "OLED %s driver probed as %s%d\n", bus->name, DEVICE_NAME, oled->minor);
+    return 0;
 
+err_device:
+    put_device(&oled->device);
+    pm_runtime_dont_use_autosuspend(parent);
+    pm_runtime_set_suspended(parent);
+    dev_set_drvdata(parent, NULL);
+err_put:
+    kref_put(&oled->ref, oled_free_dev);
+    return ret;
+}
 
-void OLED_Clear(uint8_t dat)  
-{  
-	OLED_Display();
+// Tear down a panel of oled_probe_bus(), open files keep the state alive
+void oled_remove_bus(struct device *parent)
+{
+    struct oled_sh1106 *oled = dev_get_drvdata(parent);
+
+    debugfs_remove_recursive(oled->debugfs);
+    cdev_device_del(&oled->cdev, &oled->device);
+
+    mutex_lock(&oled->lock);
+    oled->removed = true;
+    oled_anim_stop(oled);
+    mutex_unlock(&oled->lock);
+    wake_up_interruptible(&oled->anim_wait);   // waiters of a stopped animation are gone already
+    wake_up_interruptible(&oled->frame_wait);  // frames of a cancelled flush never complete
+
+    cancel_work_sync(&oled->anim_work);
+    cancel_work_sync(&oled->flush_work);
+    pm_runtime_disable(parent);
+    pm_runtime_dont_use_autosuspend(parent);
+    pm_runtime_set_suspended(parent);
+    if (!keep_panel)
+        OLED_SH1106_DisplayDeInit(&oled->panel);
+    dev_info(parent, "OLED %s driver removed\n", oled->bus->name);
+    put_device(&oled->device);
+    kref_put(&oled->ref, oled_free_dev);
 }
 
-void OLED_Display(void)
+// Probe function
+static int oled_probe(struct spi_device *spi)
 {
-	uint8_t i,n;		    
-	for(i=0;i<PAGESIZE;i++)  
-	{  
-		OLED_SH1106_Write(true,YLevel+i);    //Set page address(0~7)
-		OLED_SH1106_Write(true,XLevelL);      //Set column low address
-		OLED_SH1106_Write(true,XLevelH);      //Set column high address  
-		for(n=0;n<WIDTH;n++)
-		{
-			OLED_SH1106_Write(false, OLED_buffer[i*WIDTH+n]); 
-		}
-	}  
+    int ret;
+    u32 spi_freq;
+
+    // Get SPI frequency from device tree
+    ret = of_property_read_u32(spi->dev.of_node, "spi-max-frequency", &spi_freq);
+    if (ret)
+    {
+        dev_err(&spi->dev, "Failed to read SPI frequency from device tree\n");
+        return ret;
+    }
+
+    // Set up SPI device
+    spi->max_speed_hz = spi_freq;
+    spi_setup(spi);
+
+    return oled_probe_bus(&spi->dev, &oled_spi_bus, spi);
+}
+
+// Remove function
+static void oled_remove(struct spi_device *spi)
+{
+    oled_remove_bus(&spi->dev);
+}
+
+static int oled_runtime_suspend(struct device *dev)
+{
+    struct oled_sh1106 *oled = dev_get_drvdata(dev);
+
+    return OLED_SH1106_Sleep(&oled->panel);
+}
+
+static int oled_runtime_resume(struct device *dev)
+{
+    struct oled_sh1106 *oled = dev_get_drvdata(dev);
+    int ret;
+
+    ret = OLED_SH1106_Wake(&oled->panel, oled->ram_lost);
+    if (!ret)
+        oled->ram_lost = false;
+    return ret;
+}
+
+static int oled_suspend(struct device *dev)
+{
+    struct oled_sh1106 *oled = dev_get_drvdata(dev);
+    int ret;
+
+    // a running animation would keep queueing frames into the sleep
+    mutex_lock(&oled->lock);
+    oled_anim_stop(oled);
+    mutex_unlock(&oled->lock);
+
+    ret = pm_runtime_force_suspend(dev);
+    if (!ret)
+        oled->ram_lost = true;   // the supply may be off until resume
+    return ret;
+}
+
+const struct dev_pm_ops oled_pm_ops = {
+    SYSTEM_SLEEP_PM_OPS(oled_suspend, pm_runtime_force_resume)
+    RUNTIME_PM_OPS(oled_runtime_suspend, oled_runtime_resume, NULL)
+};
+
+// Device tree compatible strings
+static const struct of_device_id oled_spi_dt_ids[] = {
+    {.compatible = "sh1106"},
+    {},
+};
+MODULE_DEVICE_TABLE(of, oled_spi_dt_ids);
+
+// SPI driver structure
+static struct spi_driver oled_spi_driver = {
+    .driver = {
+        .name = "oled_spi_driver",
+        .of_match_table = of_match_ptr(oled_spi_dt_ids),
+        .pm = pm_ptr(&oled_pm_ops),
+    },
+    .probe = oled_probe,
+    .remove = oled_remove,
+    
+};
+
+// Module initialization
+static int __init oled_init(void)
+{
+    int ret;
+    OLED_SH1106_BuildGlyphCache();
+
+    ret = alloc_chrdev_region(&oled_devt, 0, OLED_MAX_DEVICES, DEVICE_NAME);
+    if (ret < 0)
+    {
+        pr_err("Failed to register char device region\n");
+        return ret;
+    }
+
+    oled_class = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(oled_class))
+    {
+        pr_err("Failed to register device class\n");
+        unregister_chrdev_region(oled_devt, OLED_MAX_DEVICES);
+        return PTR_ERR(oled_class);
+    }
+
+    ret = spi_register_driver(&oled_spi_driver);
+    if (ret < 0)
+    {
+        class_destroy(oled_class);
+        unregister_chrdev_region(oled_devt, OLED_MAX_DEVICES);
+        pr_err("Failed to register SPI driver\n");
+        return ret;
+    }
+
+    ret = oled_i2c_register();
+    if (ret < 0)
+    {
+        spi_unregister_driver(&oled_spi_driver);
+        class_destroy(oled_class);
+        unregister_chrdev_region(oled_devt, OLED_MAX_DEVICES);
+        pr_err("Failed to register I2C driver\n");
+        return ret;
+    }
+
+    pr_info("OLED driver initialized\n");
+    return 0;
+}
+
+// Module cleanup
+static void __exit oled_exit(void)
+{
+    oled_i2c_unregister();
+    spi_unregister_driver(&oled_spi_driver);
+    class_destroy(oled_class);
+    unregister_chrdev_region(oled_devt, OLED_MAX_DEVICES);
+    pr_info("OLED driver exited\n");
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_FlushWork
+ *
+ * Details : Flush worker. Sends the queued frames oldest first, each
+ *           without holding the framebuffer lock, so the next frames can
+ *           be drawn and queued meanwhile. Accounts the flush latency,
+ *           counted from the OLED_SH1106_Flush() call that queued the
+ *           frame, and completes the frame once it is sent.
+ ****************************************************************************/
+static void OLED_SH1106_FlushWork( struct work_struct *work )
+{
+  struct oled_sh1106 *oled = container_of( work, struct oled_sh1106, flush_work );
+  struct sh1106_stats *st = &oled->panel.stats;
+  struct oled_qframe *f;
+  unsigned int pages, page;
+  size_t bytes;
+  u64 lat_us;
+  int ret;
+
+  // wakes a sleeping panel before anything is taken from the queue
+  ret = pm_runtime_resume_and_get( oled->parent );
+  if( ret < 0 )
+  {
+    dev_warn_ratelimited( oled->dev, "Failed to wake the panel: %d\n", ret );
+    // the frames go back to the dirty spans for the next flush, but their waiters are released
+    mutex_lock( &oled->lock );
+    oled_queue_abort( oled );
+    oled_frame_done( oled, atomic64_read( &oled->frame_submitted ) );
+    mutex_unlock( &oled->lock );
+    return;
+  }
+
+  for( ;; )
+  {
+    mutex_lock( &oled->lock );
+    if( oled->queue_len == 0u )
+    {
+      mutex_unlock( &oled->lock );
+      break;
+    }
+    f = oled->queue[0];
+    oled->queue_busy = true;
+    mutex_unlock( &oled->lock );
+
+    pages = 0;
+    for( page = 0; page < SH1106_PAGES; page++ )
+    {
+      pages += ( memchr_inv( f->plan.cols[page], 0, sizeof(f->plan.cols[page]) ) != NULL );
+    }
+
+    mutex_lock( &oled->bus_lock );
+    trace_sh1106_flush_start( oled->minor, pages );
+    ret = OLED_SH1106_Send( &oled->panel, &f->plan, &bytes );
+
+    lat_us = ktime_us_delta( ktime_get(), f->queued );
+    trace_sh1106_flush_done( oled->minor, bytes, ret, lat_us * NSEC_PER_USEC );
+    if( ret < 0 )
+    {
+      st->dropped++;
+    }
+    else
+    {
+      st->flushes++;
+      st->lat_total_us += lat_us;
+      if( lat_us > st->lat_max_us )
+      {
+        st->lat_max_us = lat_us;
+      }
+      st->lat_hist[min_t( unsigned int, lat_us ? ilog2( lat_us ) + 1 : 0, OLED_LAT_BUCKETS - 1 )]++;
+    }
+    mutex_unlock( &oled->bus_lock );
+
+    mutex_lock( &oled->lock );
+    oled_queue_remove( oled, 0 );
+    oled->queue_busy = false;
+    oled_frame_done( oled, f->seq );
+    mutex_unlock( &oled->lock );
+  }
+
+  pm_runtime_mark_last_busy( oled->parent );
+  pm_runtime_put_autosuspend( oled->parent );
 }
 
 
@@ -0,0 +1,582 @@
+/*
+** Benchmark for the SH1106 OLED driver.
+**
+** Runs standard workloads and reports operations per second, p50/p99
+** latency per operation and bus bytes per frame, either against a real
+** panel (/dev/oled_sh1106N) or against the driver core running on the
+** emulated bus in sim/.
+**
+**   oled_bench [-d device] [-n count] [-w workload]      real device
+**   oled_bench -s [-i] [-f hz] [-t us] [-c cost] [-n count] [-w workload]
+**                                                          simulated bus
+**
+** Device mode times each ioctl()/write() and waits with poll() for the
+** flush worker to go idle at the end of a workload, so ops/s includes the
+** time on the bus. Bus numbers and the flush latency percentiles come from
+** <debugfs>/oled_sh1106N/stats and need root; without them only the call
+** latency is shown. The flush latency percentiles have the resolution of
+** the debugfs histogram (powers of two).
+**
+** Simulation mode runs the same operations through the core in-process.
+** The latency of an operation is its CPU time plus the bus time of the
+** bytes it produced at the given SPI clock (-f, default 8 MHz) with a
+** fixed cost per transfer (-t, default 5 us), so different spi-max-
+** frequency settings can be compared without hardware. -c sets the
+** transfer cost the flush planner works with, as the xfer_cost module
+** parameter does for the device. -i simulates the I2C variant: the bytes
+** then include the slave address and control bytes, take 9 clocks each
+** and the clock defaults to 400 kHz.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "sh1106_ioctl.h"
+#include "sh1106_sim.h"
+
+#define DEFAULT_DEVICE      "/dev/oled_sh11060"
+#define DEFAULT_COUNT       200
+#define DEFAULT_SPI_HZ      8000000.0
+#define DEFAULT_I2C_HZ      400000.0
+#define DEFAULT_XFER_US     5.0
+#define STREAM_CHARS        1000
+
+// Counters read back after a workload, from debugfs or the emulator
+struct bus_counters {
+    unsigned long long transfers;
+    unsigned long long bytes;
+    unsigned long long flushes;
+    unsigned long long dropped;
+    unsigned long long hist[OLED_LAT_BUCKETS];
+};
+
+struct bench {
+    bool sim;
+    bool i2c;                             // simulated panel on I2C
+    int fd;
+    char stats_path[128];
+    bool have_stats;
+    struct sh1106_sim emu;
+    double bus_hz;                        // clock of the simulated bus
+    double xfer_us;
+    int xfer_cost;
+    uint8_t frame[OLED_SH1106_FB_SIZE];   // last uploaded frame, for the deltas
+};
+
+struct workload {
+    const char *name;
+    const char *what;
+    int (*run)(struct bench *b, int i);
+};
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Parse the debugfs stats file of the device
+static bool read_stats(struct bench *b, struct bus_counters *c)
+{
+    char line[128];
+    unsigned long long v;
+    int bucket = 0;
+    FILE *f;
+
+    memset(c, 0, sizeof(*c));
+    f = fopen(b->stats_path, "r");
+    if (!f)
+        return false;
+
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+
+        if (!colon || sscanf(colon + 1, "%llu", &v) != 1)
+            continue;
+        if (!strncmp(line, "transfers:", 10))
+            c->transfers = v;
+        else if (!strncmp(line, "bytes:", 6))
+            c->bytes = v;
+        else if (!strncmp(line, "flushes:", 8))
+            c->flushes = v;
+        else if (!strncmp(line, "dropped:", 8))
+            c->dropped = v;
+        else if (line[0] == ' ' && bucket < OLED_LAT_BUCKETS)
+            c->hist[bucket++] = v;   // latency_hist_us lines, in bucket order
+    }
+    fclose(f);
+    return true;
+}
+
+static void read_counters(struct bench *b, struct bus_counters *c)
+{
+    if (b->sim) {
+        memset(c, 0, sizeof(*c));
+        c->transfers = b->emu.count.transfers;
+        c->bytes = b->i2c ? b->emu.count.i2c_bytes : b->emu.count.cmd_bytes + b->emu.count.data_bytes;
+        c->flushes = b->emu.count.flushes;
+    } else if (b->have_stats) {
+        read_stats(b, c);
+    } else {
+        memset(c, 0, sizeof(*c));
+    }
+}
+
+// Wait until the flush worker has sent everything that was queued
+static void wait_idle(struct bench *b)
+{
+    struct pollfd pfd = { .fd = b->fd, .events = POLLIN };
+
+    if (b->sim)
+        return;
+
+    // the device is readable once no frame is in flight
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+        ;
+}
+
+/*
+** Workloads. Each call is one operation; the simulated variants run the
+** same core functions as the corresponding ioctl or write() in the
+** driver, including the flush.
+*/
+static int op_fill(struct bench *b, int i)
+{
+    uint8_t value = (i & 1) ? 0xFF : 0x00;
+
+    if (b->sim) {
+        OLED_SH1106_fill(&b->emu.panel, value);
+        OLED_SH1106_Flush(&b->emu.panel);
+        return 0;
+    }
+    return ioctl(b->fd, IOCTL_FILL_DISPLAY, &value);
+}
+
+static int op_logo(struct bench *b, int i)
+{
+    (void)i;
+    if (b->sim) {
+        OLED_SH1106_PrintLogo(&b->emu.panel);
+        OLED_SH1106_Flush(&b->emu.panel);
+        return 0;
+    }
+    return ioctl(b->fd, IOCTL_PRINT_LOGO);
+}
+
+static int op_text_line(struct bench *b, int i)
+{
+    char text[32];
+    int len = snprintf(text, sizeof(text), "update %06d", i);
+    struct oled_dl_op ops[2] = {
+        { .op = OLED_OP_CURSOR, .x = 0, .y = 3 },
+        { .op = OLED_OP_TEXT, .len = len, .data = (uintptr_t)text },
+    };
+    struct oled_display_list dl = { .count = 2, .ops = (uintptr_t)ops };
+
+    if (b->sim) {
+        OLED_SH1106_SetCursor(&b->emu.panel, 3, 0);
+        OLED_SH1106_Text(&b->emu.panel, text, len);
+        OLED_SH1106_Flush(&b->emu.panel);
+        return 0;
+    }
+    return ioctl(b->fd, IOCTL_DISPLAY_LIST, &dl);
+}
+
+static int console_write(struct bench *b, const char *buf, size_t len)
+{
+    if (b->sim) {
+        OLED_SH1106_ConsoleWrite(&b->emu.panel, buf, len);
+        OLED_SH1106_ConsoleRender(&b->emu.panel);
+        OLED_SH1106_Flush(&b->emu.panel);
+        return 0;
+    }
+    return write(b->fd, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+static int op_stream(struct bench *b, int i)
+{
+    char buf[STREAM_CHARS];
+    int n;
+
+    // lines of varying length, as from a log
+    for (n = 0; n < STREAM_CHARS; n++)
+        buf[n] = ((n + i) % 37 == 36) ? '\n' : 'a' + (n + i) % 26;
+    return console_write(b, buf, sizeof(buf));
+}
+
+static int op_scroll_log(struct bench *b, int i)
+{
+    char line[32];
+    int len = snprintf(line, sizeof(line), "event %d ok\n", i);
+
+    return console_write(b, line, len);
+}
+
+/*
+** Encodes a frame for IOCTL_UPLOAD. With prev the XOR delta against it is
+** encoded and unchanged bytes become skips, otherwise the frame itself
+** with literal and repeat codes. Returns the stream length.
+*/
+static size_t upload_encode(const uint8_t *cur, const uint8_t *prev, uint8_t *out)
+{
+    uint8_t d[OLED_SH1106_FB_SIZE];
+    size_t i = 0, o = 0, n, lit;
+
+    for (n = 0; n < OLED_SH1106_FB_SIZE; n++)
+        d[n] = prev ? cur[n] ^ prev[n] : cur[n];
+
+    while (i < OLED_SH1106_FB_SIZE) {
+        if (prev && d[i] == 0) {
+            for (n = 1; i + n < OLED_SH1106_FB_SIZE && n < 128 && d[i + n] == 0; n++)
+                ;
+            out[o++] = 0x80 | (n - 1);
+            i += n;
+            continue;
+        }
+        for (n = 1; i + n < OLED_SH1106_FB_SIZE && n < 65 && d[i + n] == d[i]; n++)
+            ;
+        if (n >= 2) {
+            out[o++] = 0x40 | (n - 2);
+            out[o++] = d[i];
+            i += n;
+            continue;
+        }
+        // literals up to the next run or skip
+        for (lit = 1; i + lit < OLED_SH1106_FB_SIZE && lit < 64; lit++) {
+            if (prev && d[i + lit] == 0)
+                break;
+            if (i + lit + 1 < OLED_SH1106_FB_SIZE && d[i + lit] == d[i + lit + 1])
+                break;
+        }
+        out[o++] = lit - 1;
+        memcpy(&out[o], &d[i], lit);
+        o += lit;
+        i += lit;
+    }
+    return o;
+}
+
+// A mostly blank dashboard: a changing readout and a bar
+static void dashboard_frame(uint8_t *frame, int i)
+{
+    int x;
+
+    memset(frame, 0, OLED_SH1106_FB_SIZE);
+    for (x = 0; x < 24; x++) {
+        frame[2 * OLED_SH1106_WIDTH + 40 + x] = (uint8_t)((i * 37 + x * 11) | 0x81);
+        frame[3 * OLED_SH1106_WIDTH + 40 + x] = (uint8_t)((i * 53 + x * 7) | 0x81);
+    }
+    for (x = 0; x < (i * 5) % OLED_SH1106_WIDTH; x++)
+        frame[6 * OLED_SH1106_WIDTH + x] = 0x3C;
+}
+
+static int upload(struct bench *b, const uint8_t *frame, bool delta)
+{
+    uint8_t data[OLED_UPLOAD_MAX_DATA];
+    struct oled_upload up = {
+        .len = upload_encode(frame, delta ? b->frame : NULL, data),
+        .format = delta ? OLED_UPLOAD_XOR : OLED_UPLOAD_RLE,
+        .data = (uintptr_t)data,
+    };
+
+    memcpy(b->frame, frame, OLED_SH1106_FB_SIZE);
+    if (b->sim) {
+        OLED_SH1106_Upload(&b->emu.panel, data, up.len, up.format);
+        OLED_SH1106_Flush(&b->emu.panel);
+        return 0;
+    }
+    return ioctl(b->fd, IOCTL_UPLOAD, &up);
+}
+
+static int op_upload(struct bench *b, int i)
+{
+    uint8_t frame[OLED_SH1106_FB_SIZE];
+
+    dashboard_frame(frame, i);
+    return upload(b, frame, false);
+}
+
+static int op_upload_delta(struct bench *b, int i)
+{
+    uint8_t frame[OLED_SH1106_FB_SIZE];
+
+    dashboard_frame(frame, i);
+    return upload(b, frame, i > 0);   // the first frame sets the base
+}
+
+/*
+** Three widgets of different sizes updated at different rates, each
+** through IOCTL_UPDATE_RECT with its own 1 bpp pixels: a 24 x 16 readout
+** every op, a 48 x 8 bar every 2nd and a 16 x 16 icon every 4th.
+*/
+static int op_widgets(struct bench *b, int i)
+{
+    static const struct { int x, y, w, h, every; } widgets[] = {
+        { 40, 20, 24, 16, 1 }, { 0, 56, 48, 8, 2 }, { 104, 4, 16, 16, 4 },
+    };
+    uint8_t pixels[6 * 16];
+    size_t n, k;
+    int ret;
+
+    for (n = 0; n < sizeof(widgets) / sizeof(widgets[0]); n++) {
+        struct oled_image img = {
+            .x = widgets[n].x, .y = widgets[n].y, .w = widgets[n].w, .h = widgets[n].h,
+            .rop = OLED_ROP_COPY, .data = (uintptr_t)pixels,
+        };
+
+        if (i % widgets[n].every)
+            continue;
+        for (k = 0; k < sizeof(pixels); k++)
+            pixels[k] = (uint8_t)(i * 29 + k * 13 + n);
+        if (b->sim) {
+            OLED_SH1106_Image(&b->emu.panel, img.x, img.y, img.w, img.h, pixels, (img.w + 7) / 8, img.rop);
+            OLED_SH1106_Flush(&b->emu.panel);
+            continue;
+        }
+        ret = ioctl(b->fd, IOCTL_UPDATE_RECT, &img);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+** A full-screen XRGB8888 surface with a moving shaded ball, as a UI
+** toolkit would render it, converted and dithered by the driver.
+*/
+static int op_pixels(struct bench *b, int i)
+{
+    static uint32_t surface[OLED_SH1106_HEIGHT][OLED_SH1106_WIDTH];
+    struct oled_pixels px = {
+        .w = OLED_SH1106_WIDTH, .h = OLED_SH1106_HEIGHT, .format = OLED_PIXEL_XRGB8888,
+        .dither = OLED_DITHER_FLOYD_STEINBERG, .data = (uintptr_t)surface,
+    };
+    int cx = (i * 3) % OLED_SH1106_WIDTH, cy = 32, x, y;
+    uint32_t d, v;
+
+    for (y = 0; y < OLED_SH1106_HEIGHT; y++) {
+        for (x = 0; x < OLED_SH1106_WIDTH; x++) {
+            d = (uint32_t)((x - cx) * (x - cx) + (y - cy) * (y - cy));
+            v = d < 24u * 24u ? 255u - d * 255u / (24u * 24u) : (uint32_t)x;
+            surface[y][x] = v << 16 | v << 8 | v;
+        }
+    }
+    if (b->sim) {
+        OLED_SH1106_Pixels(&b->emu.panel, px.x, px.y, px.w, px.h, (const uint8_t *)surface,
+                           sizeof(surface[0]), px.format, px.dither, px.level);
+        OLED_SH1106_Flush(&b->emu.panel);
+        return 0;
+    }
+    return ioctl(b->fd, IOCTL_UPDATE_PIXELS, &px);
+}
+
+static const struct workload workloads[] = {
+    { "fill",       "full-frame fill",               op_fill },
+    { "logo",       "logo blit",                     op_logo },
+    { "text_line",  "one-line text update",          op_text_line },
+    { "stream",     "1000-character text stream",    op_stream },
+    { "scroll_log", "scrolling log, one line per op", op_scroll_log },
+    { "upload",     "RLE upload of a dashboard frame", op_upload },
+    { "upload_xor", "XOR delta upload of the same",  op_upload_delta },
+    { "widgets",    "partial updates of 3 widgets",  op_widgets },
+    { "pixels",     "dithered XRGB8888 frame",       op_pixels },
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Percentile of the flush latency from a debugfs histogram delta, in us
+static unsigned long long hist_percentile(const unsigned long long *hist, double pct)
+{
+    unsigned long long total = 0, seen = 0;
+    int i;
+
+    for (i = 0; i < OLED_LAT_BUCKETS; i++)
+        total += hist[i];
+    if (!total)
+        return 0;
+    for (i = 0; i < OLED_LAT_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen * 100.0 >= total * pct)
+            return i ? (1ULL << i) - 1 : 0;   // upper bound of the bucket
+    }
+    return 0;
+}
+
+static int run_workload(struct bench *b, const struct workload *w, int count)
+{
+    struct bus_counters before, after;
+    double *lat, start, end, t0, total = 0;
+    unsigned long long frames, bytes, transfers;
+    int i;
+
+    lat = calloc(count, sizeof(*lat));
+    if (!lat)
+        return -ENOMEM;
+
+    wait_idle(b);
+    read_counters(b, &before);
+    start = now_us();
+    for (i = 0; i < count; i++) {
+        struct bus_counters c0, c1;
+
+        if (b->sim)
+            read_counters(b, &c0);
+        t0 = now_us();
+        if (w->run(b, i) < 0) {
+            perror(w->name);
+            free(lat);
+            return -errno;
+        }
+        lat[i] = now_us() - t0;
+        if (b->sim) {
+            // add the time the bytes of this operation spend on the bus
+            read_counters(b, &c1);
+            lat[i] += (c1.bytes - c0.bytes) * (b->i2c ? 9 : 8) * 1e6 / b->bus_hz +
+                      (c1.transfers - c0.transfers) * b->xfer_us;
+            total += lat[i];
+        }
+    }
+    wait_idle(b);
+    end = now_us();
+    read_counters(b, &after);
+    if (!b->sim)
+        total = end - start;
+
+    frames = after.flushes - before.flushes;
+    bytes = after.bytes - before.bytes;
+    transfers = after.transfers - before.transfers;
+
+    qsort(lat, count, sizeof(*lat), cmp_double);
+    printf("%-11s %6d %9.1f %9.1f %9.1f", w->name, count, count * 1e6 / total,
+           lat[count / 2], lat[(count * 99) / 100]);
+    if (b->sim || b->have_stats) {
+        unsigned long long hist[OLED_LAT_BUCKETS];
+
+        printf(" %7llu %9.1f %8.1f", frames, frames ? (double)bytes / frames : 0.0,
+               frames ? (double)transfers / frames : 0.0);
+        if (!b->sim) {
+            for (i = 0; i < OLED_LAT_BUCKETS; i++)
+                hist[i] = after.hist[i] - before.hist[i];
+            printf(" %8llu %8llu", hist_percentile(hist, 50), hist_percentile(hist, 99));
+        }
+    }
+    printf("\n");
+
+    free(lat);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    size_t i;
+
+    fprintf(stderr,
+            "usage: %s [-d device] [-s [-i] [-f hz] [-t xfer_us] [-c cost]] [-n count] [-w workload]\n"
+            "  -d  device node (default " DEFAULT_DEVICE ")\n"
+            "  -s  use the simulated bus instead of a device\n"
+            "  -i  simulate an I2C panel instead of SPI\n"
+            "  -f  clock of the simulated bus in Hz (default 8000000, 400000 with -i)\n"
+            "  -t  fixed cost per simulated transfer in us (default 5)\n"
+            "  -c  transfer cost in bytes for the flush planner (default %d)\n"
+            "  -n  operations per workload (default %d)\n"
+            "  -w  run only this workload:", prog, SH1106_XFER_COST, DEFAULT_COUNT);
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+        fprintf(stderr, " %s", workloads[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static struct bench b;
+    const char *device = DEFAULT_DEVICE;
+    const char *only = NULL;
+    int count = DEFAULT_COUNT;
+    size_t i;
+    int opt;
+
+    b.bus_hz = 0;
+    b.xfer_us = DEFAULT_XFER_US;
+    b.xfer_cost = -1;
+    while ((opt = getopt(argc, argv, "d:sif:t:c:n:w:h")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 's': b.sim = true; break;
+        case 'i': b.i2c = true; break;
+        case 'f': b.bus_hz = atof(optarg); break;
+        case 't': b.xfer_us = atof(optarg); break;
+        case 'c': b.xfer_cost = atoi(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        case 'w': only = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : EINVAL;
+        }
+    }
+    if (b.bus_hz == 0)
+        b.bus_hz = b.i2c ? DEFAULT_I2C_HZ : DEFAULT_SPI_HZ;
+    if (count <= 0 || b.bus_hz <= 0) {
+        usage(argv[0]);
+        return EINVAL;
+    }
+
+    if (b.sim) {
+        if (b.i2c)
+            sh1106_sim_init_i2c(&b.emu);
+        else
+            sh1106_sim_init(&b.emu);
+        if (b.xfer_cost >= 0)
+            b.emu.panel.xfer_cost = b.xfer_cost;
+        OLED_SH1106_DisplayInit(&b.emu.panel);
+        printf("simulated %s bus, %.0f Hz, %.1f us per transfer, planner cost %u\n",
+               b.i2c ? "I2C" : "SPI", b.bus_hz, b.xfer_us, b.emu.panel.xfer_cost);
+    } else {
+        const char *name = strrchr(device, '/');
+
+        b.fd = open(device, O_RDWR);
+        if (b.fd < 0) {
+            perror("Failed to open the device");
+            return errno;
+        }
+        snprintf(b.stats_path, sizeof(b.stats_path), "/sys/kernel/debug/%s/stats",
+                 name ? name + 1 : device);
+        b.have_stats = (access(b.stats_path, R_OK) == 0);
+        if (ioctl(b.fd, IOCTL_INIT_DISPLAY) < 0) {
+            perror("IOCTL_INIT_DISPLAY");
+            close(b.fd);
+            return errno;
+        }
+        printf("%s%s\n", device, b.have_stats ? "" : " (no debugfs stats, run as root for bus numbers)");
+    }
+
+    printf("%-11s %6s %9s %9s %9s", "workload", "ops", "ops/s", "p50_us", "p99_us");
+    if (b.sim || b.have_stats)
+        printf(" %7s %9s %8s", "frames", "B/frame", "xfer/fr");
+    if (!b.sim && b.have_stats)
+        printf(" %8s %8s", "fl_p50", "fl_p99");
+    printf("\n");
+
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        if (only && strcmp(only, workloads[i].name))
+            continue;
+        if (run_workload(&b, &workloads[i], count) < 0)
+            break;
+    }
+
+    if (!b.sim)
+        close(b.fd);
+    return 0;
+}
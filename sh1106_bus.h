@@ -0,0 +1,31 @@
+/*
+** Bus backends of the kernel driver. driver_spi_sh1106.c keeps the
+** character device, the flush worker and power management of every
+** panel and drives SPI panels itself, sh1106_i2c.c adds I2C panels.
+** A backend only moves runs of bytes: it probes a panel through
+** oled_probe_bus() and gets its context back in write(), where data
+** tells display data from commands.
+*/
+#ifndef SH1106_BUS_H
+#define SH1106_BUS_H
+
+#include <linux/device.h>
+#include <linux/pm.h>
+#include <linux/types.h>
+
+struct oled_bus
+{
+    const char *name;
+    bool dc_gpio;                             // commands and data are told apart by a DC line
+    int (*write)(void *ctx, const u8 *buf, size_t len, bool data);   // called with the bus lock held
+};
+
+extern const struct dev_pm_ops oled_pm_ops;
+
+int  oled_probe_bus(struct device *parent, const struct oled_bus *bus, void *ctx);
+void oled_remove_bus(struct device *parent);
+
+int  oled_i2c_register(void);
+void oled_i2c_unregister(void);
+
+#endif /* SH1106_BUS_H */
@@ -0,0 +1,2453 @@
+/*
+** Transport independent part of the SH1106 OLED driver: framebuffer,
+** dirty tracking, text, console, scrolling and the command sequences.
+**
+** Everything that touches the hardware goes through the bus operations
+** of struct sh1106_panel, so the same code runs in the kernel module on
+** top of SPI (driver_spi_sh1106.c) and in userspace on top of the
+** emulator in sim/.
+*/
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#else
+#include <errno.h>
+#include <string.h>
+#endif
+
+#include "sh1106_core.h"
+
+#define PAGESIZE    8          //page size
+#define XLevelL		 0x02       //column low address
+#define XLevelH		 0x10       //column high address
+#define YLevel       0xB0       //page address
+#define	Brightness	 0xFF 
+#define WIDTH 	     128        //oled screen width
+#define HEIGHT 	     64	        //oled screen height
+/*
+**  EmbeTronicX Logo
+*/
+static const uint8_t OLED_logo[1024] = {
+  0xFF, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xE1, 0xF9, 0xFF, 0xF9, 0xE1, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xF8, 0xFF, 0x0F, 0xFF, 0xFF, 0xFF, 0x3F, 0xFF,
+  0xF8, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0xFF, 0xFF, 0x0F, 0xF8, 0xF7, 0x00, 0xBF, 0xC0, 0x7F,
+  0xFF, 0xFF, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x3F, 0xE0, 0x0F, 0x7F, 0x00, 0xFF, 0x7F, 0x80,
+  0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x04, 0xFC, 0xFC, 0x0C, 0x0C, 0x0C, 0x0C, 0x7C, 0x00, 0x00, 0x00,
+  0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x04, 0xFC, 0xF8,
+  0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x08,
+  0x04, 0x04, 0xFC, 0xFC, 0x04, 0x04, 0x04, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x98, 0x98, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80,
+  0x00, 0x00, 0x04, 0x0C, 0x38, 0xE0, 0x80, 0xE0, 0x38, 0x0C, 0x04, 0x00, 0x00, 0x00, 0x00, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xC0, 0x3F, 0xFF, 0xFF, 0x00, 0xFD, 0xFE, 0xFF,
+  0x01, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x06, 0x06, 0x06, 0x06, 0xE0, 0x00, 0x00, 0x00,
+  0x00, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF,
+  0x00, 0x00, 0xFF, 0xFE, 0x00, 0x00, 0x00, 0x7C, 0xFF, 0x11, 0x10, 0x1F, 0x1F, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x7C, 0xFF, 0x01, 0x00, 0x01, 0xFF, 0x7C, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x87,
+  0x00, 0x00, 0x00, 0x00, 0xE0, 0x3F, 0x1F, 0xFF, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x1F, 0x3F, 0xFC, 0xF7, 0x00, 0xDF, 0xE3, 0x7D,
+  0x3E, 0x07, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x00, 0x00, 0x00,
+  0x00, 0x03, 0x03, 0x00, 0x03, 0x03, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03,
+  0x02, 0x02, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x03, 0x02, 0x02, 0x01, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x01, 0x03, 0x02, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x03,
+  0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x01, 0x03, 0x03, 0x02, 0x02, 0x03,
+  0x00, 0x00, 0x02, 0x03, 0x01, 0x00, 0x00, 0x00, 0x01, 0x03, 0x02, 0x00, 0x00, 0x00, 0x00, 0xFF,
+  0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xFF, 0x00, 0xFF, 0x03, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0x88, 0x88, 0x08, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x20, 0xE0,
+  0x00, 0xFC, 0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xFC, 0x00,
+  0xE0, 0x20, 0x20, 0xFC, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xFC, 0x00, 0x00,
+  0x00, 0x08, 0x08, 0xF8, 0x08, 0x08, 0x00, 0xE0, 0x00, 0xE0, 0x00, 0xFC, 0x20, 0x20, 0x00, 0xE0,
+  0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0x00, 0xEC, 0x00, 0x20, 0x20, 0x20, 0xE0, 0x00, 0xFC,
+  0x00, 0xE0, 0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0x00, 0x08, 0x08, 0xC8, 0x38, 0x00, 0x00, 0xE0,
+  0x20, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0xE0, 0x00, 0xE0, 0x20, 0x20, 0xE0, 0x00, 0x00, 0x00, 0xFF,
+  0xFF, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x9C, 0x9C, 0x88, 0x8E, 0x83, 0x98, 0x83, 0x8E, 0x88,
+  0x88, 0x9C, 0x9C, 0x80, 0x80, 0x87, 0x84, 0x84, 0x84, 0x80, 0x87, 0x80, 0x80, 0x87, 0x80, 0x87,
+  0x80, 0x87, 0x84, 0x84, 0x87, 0x80, 0x87, 0x85, 0x85, 0x85, 0x80, 0x87, 0x84, 0x84, 0x87, 0x80,
+  0x87, 0x84, 0x84, 0x87, 0x80, 0x87, 0x85, 0x85, 0x85, 0x80, 0x87, 0x84, 0x84, 0x87, 0x80, 0x80,
+  0x80, 0x80, 0x80, 0x87, 0x80, 0x80, 0x80, 0x87, 0x84, 0x87, 0x80, 0x87, 0x84, 0x84, 0x80, 0x87,
+  0x84, 0x84, 0x87, 0x80, 0x87, 0x80, 0x80, 0x80, 0x87, 0x80, 0x87, 0x85, 0x85, 0x87, 0x80, 0x87,
+  0x80, 0x85, 0x85, 0x85, 0x87, 0x80, 0x80, 0x80, 0x80, 0x86, 0x85, 0x84, 0x84, 0x84, 0x80, 0x87,
+  0x84, 0x84, 0x87, 0x80, 0x87, 0x80, 0x87, 0x80, 0x87, 0x85, 0x85, 0x85, 0x80, 0x80, 0x80, 0xFF,
+};
+
+
+/*
+** Array Variable to store the letters.
+*/ 
+static const unsigned char SH1106_font[][SH1106_DEF_FONT_SIZE]= 
+{
+    {0x00, 0x00, 0x00, 0x00, 0x00},   // space
+    {0x00, 0x00, 0x2f, 0x00, 0x00},   // !
+    {0x00, 0x07, 0x00, 0x07, 0x00},   // "
+    {0x14, 0x7f, 0x14, 0x7f, 0x14},   // #
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12},   // $
+    {0x23, 0x13, 0x08, 0x64, 0x62},   // %
+    {0x36, 0x49, 0x55, 0x22, 0x50},   // &
+    {0x00, 0x05, 0x03, 0x00, 0x00},   // '
+    {0x00, 0x1c, 0x22, 0x41, 0x00},   // (
+    {0x00, 0x41, 0x22, 0x1c, 0x00},   // )
+    {0x14, 0x08, 0x3E, 0x08, 0x14},   // *
+    {0x08, 0x08, 0x3E, 0x08, 0x08},   // +
+    {0x00, 0x00, 0xA0, 0x60, 0x00},   // ,
+    {0x08, 0x08, 0x08, 0x08, 0x08},   // -
+    {0x00, 0x60, 0x60, 0x00, 0x00},   // .
+    {0x20, 0x10, 0x08, 0x04, 0x02},   // /
+    {0x3E, 0x51, 0x49, 0x45, 0x3E},   // 0
+    {0x00, 0x42, 0x7F, 0x40, 0x00},   // 1
+    {0x42, 0x61, 0x51, 0x49, 0x46},   // 2
+    {0x21, 0x41, 0x45, 0x4B, 0x31},   // 3
+    {0x18, 0x14, 0x12, 0x7F, 0x10},   // 4
+    {0x27, 0x45, 0x45, 0x45, 0x39},   // 5
+    {0x3C, 0x4A, 0x49, 0x49, 0x30},   // 6
+    {0x01, 0x71, 0x09, 0x05, 0x03},   // 7
+    {0x36, 0x49, 0x49, 0x49, 0x36},   // 8
+    {0x06, 0x49, 0x49, 0x29, 0x1E},   // 9
+    {0x00, 0x36, 0x36, 0x00, 0x00},   // :
+    {0x00, 0x56, 0x36, 0x00, 0x00},   // ;
+    {0x08, 0x14, 0x22, 0x41, 0x00},   // <
+    {0x14, 0x14, 0x14, 0x14, 0x14},   // =
+    {0x00, 0x41, 0x22, 0x14, 0x08},   // >
+    {0x02, 0x01, 0x51, 0x09, 0x06},   // ?
+    {0x32, 0x49, 0x59, 0x51, 0x3E},   // @
+    {0x7C, 0x12, 0x11, 0x12, 0x7C},   // A
+    {0x7F, 0x49, 0x49, 0x49, 0x36},   // B
+    {0x3E, 0x41, 0x41, 0x41, 0x22},   // C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C},   // D
+    {0x7F, 0x49, 0x49, 0x49, 0x41},   // E
+    {0x7F, 0x09, 0x09, 0x09, 0x01},   // F
+    {0x3E, 0x41, 0x49, 0x49, 0x7A},   // G
+    {0x7F, 0x08, 0x08, 0x08, 0x7F},   // H
+    {0x00, 0x41, 0x7F, 0x41, 0x00},   // I
+    {0x20, 0x40, 0x41, 0x3F, 0x01},   // J
+    {0x7F, 0x08, 0x14, 0x22, 0x41},   // K
+    {0x7F, 0x40, 0x40, 0x40, 0x40},   // L
+    {0x7F, 0x02, 0x0C, 0x02, 0x7F},   // M
+    {0x7F, 0x04, 0x08, 0x10, 0x7F},   // N
+    {0x3E, 0x41, 0x41, 0x41, 0x3E},   // O
+    {0x7F, 0x09, 0x09, 0x09, 0x06},   // P
+    {0x3E, 0x41, 0x51, 0x21, 0x5E},   // Q
+    {0x7F, 0x09, 0x19, 0x29, 0x46},   // R
+    {0x46, 0x49, 0x49, 0x49, 0x31},   // S
+    {0x01, 0x01, 0x7F, 0x01, 0x01},   // T
+    {0x3F, 0x40, 0x40, 0x40, 0x3F},   // U
+    {0x1F, 0x20, 0x40, 0x20, 0x1F},   // V
+    {0x3F, 0x40, 0x38, 0x40, 0x3F},   // W
+    {0x63, 0x14, 0x08, 0x14, 0x63},   // X
+    {0x07, 0x08, 0x70, 0x08, 0x07},   // Y
+    {0x61, 0x51, 0x49, 0x45, 0x43},   // Z
+    {0x00, 0x7F, 0x41, 0x41, 0x00},   // [
+    {0x55, 0xAA, 0x55, 0xAA, 0x55},   // Backslash (Checker pattern)
+    {0x00, 0x41, 0x41, 0x7F, 0x00},   // ]
+    {0x04, 0x02, 0x01, 0x02, 0x04},   // ^
+    {0x40, 0x40, 0x40, 0x40, 0x40},   // _
+    {0x00, 0x03, 0x05, 0x00, 0x00},   // `
+    {0x20, 0x54, 0x54, 0x54, 0x78},   // a
+    {0x7F, 0x48, 0x44, 0x44, 0x38},   // b
+    {0x38, 0x44, 0x44, 0x44, 0x20},   // c
+    {0x38, 0x44, 0x44, 0x48, 0x7F},   // d
+    {0x38, 0x54, 0x54, 0x54, 0x18},   // e
+    {0x08, 0x7E, 0x09, 0x01, 0x02},   // f
+    {0x18, 0xA4, 0xA4, 0xA4, 0x7C},   // g
+    {0x7F, 0x08, 0x04, 0x04, 0x78},   // h
+    {0x00, 0x44, 0x7D, 0x40, 0x00},   // i
+    {0x40, 0x80, 0x84, 0x7D, 0x00},   // j
+    {0x7F, 0x10, 0x28, 0x44, 0x00},   // k
+    {0x00, 0x41, 0x7F, 0x40, 0x00},   // l
+    {0x7C, 0x04, 0x18, 0x04, 0x78},   // m
+    {0x7C, 0x08, 0x04, 0x04, 0x78},   // n
+    {0x38, 0x44, 0x44, 0x44, 0x38},   // o
+    {0xFC, 0x24, 0x24, 0x24, 0x18},   // p
+    {0x18, 0x24, 0x24, 0x18, 0xFC},   // q
+    {0x7C, 0x08, 0x04, 0x04, 0x08},   // r
+    {0x48, 0x54, 0x54, 0x54, 0x20},   // s
+    {0x04, 0x3F, 0x44, 0x40, 0x20},   // t
+    {0x3C, 0x40, 0x40, 0x20, 0x7C},   // u
+    {0x1C, 0x20, 0x40, 0x20, 0x1C},   // v
+    {0x3C, 0x40, 0x30, 0x40, 0x3C},   // w
+    {0x44, 0x28, 0x10, 0x28, 0x44},   // x
+    {0x1C, 0xA0, 0xA0, 0xA0, 0x7C},   // y
+    {0x44, 0x64, 0x54, 0x4C, 0x44},   // z
+    {0x00, 0x10, 0x7C, 0x82, 0x00},   // {
+    {0x00, 0x00, 0xFF, 0x00, 0x00},   // |
+    {0x00, 0x82, 0x7C, 0x10, 0x00},   // }
+    {0x00, 0x06, 0x09, 0x09, 0x06}    // ~ (Degrees)
+};
+
+/*
+** Glyph cache: every character of SH1106_font laid out exactly as it
+** goes into the framebuffer, spacer column included, so rendering a
+** character is a single fixed-size copy.
+*/
+static uint8_t SH1106_glyphs[SH1106_FONT_CHARS][SH1106_GLYPH_WIDTH];
+
+/*
+** The built-in font as font slots OLED_FONT_5X7 to OLED_FONT_5X7_3X,
+** scaled up once here so that large text costs no more to draw than
+** small text.
+*/
+static uint8_t SH1106_glyphs_2x[SH1106_FONT_CHARS][2][SH1106_DEF_FONT_SIZE * 2];
+static uint8_t SH1106_glyphs_3x[SH1106_FONT_CHARS][3][SH1106_DEF_FONT_SIZE * 3];
+static uint8_t SH1106_widths[OLED_FONT_FIRST_LOADABLE][SH1106_FONT_CHARS];
+static struct sh1106_font SH1106_fonts[OLED_FONT_FIRST_LOADABLE];
+
+/****************************************************************************
+ * Name: OLED_SH1106_ScaleGlyph
+ *
+ * Details : Scales a glyph of the built-in font: every pixel becomes a
+ *           scale x scale block, the result is scale pages high.
+ ****************************************************************************/
+static void OLED_SH1106_ScaleGlyph( uint8_t *dst, const uint8_t *src, unsigned int scale )
+{
+  unsigned int width = SH1106_DEF_FONT_SIZE * scale;
+  unsigned int x, row, page, k;
+  uint32_t col;
+
+  for( x = 0; x < SH1106_DEF_FONT_SIZE; x++ )
+  {
+    col = 0u;
+    for( row = 0; row < 8u; row++ )
+    {
+      if( src[x] & ( 1u << row ) )
+      {
+        col |= ( ( 1u << scale ) - 1u ) << ( row * scale );
+      }
+    }
+    for( page = 0; page < scale; page++ )
+    {
+      for( k = 0; k < scale; k++ )
+      {
+        dst[page * width + x * scale + k] = (uint8_t)( col >> ( page * 8u ) );
+      }
+    }
+  }
+}
+
+// Fills in the glyph offsets from the widths
+static void OLED_SH1106_FontOffsets( struct sh1106_font *font )
+{
+  unsigned int i, offset = 0;
+
+  for( i = 0; i <= (unsigned int)( font->last - font->first ); i++ )
+  {
+    font->offset[i] = offset;
+    offset += font->width[i] * font->pages;
+  }
+}
+
+
+void OLED_SH1106_BuildGlyphCache( void )
+{
+  struct sh1106_font *font;
+  unsigned int i, scale;
+
+  for( i = 0; i < ARRAY_SIZE(SH1106_glyphs); i++ )
+  {
+    memcpy( SH1106_glyphs[i], SH1106_font[i], SH1106_DEF_FONT_SIZE );
+    SH1106_glyphs[i][SH1106_DEF_FONT_SIZE] = 0x00;   // spacer column
+    OLED_SH1106_ScaleGlyph( &SH1106_glyphs_2x[i][0][0], SH1106_font[i], 2u );
+    OLED_SH1106_ScaleGlyph( &SH1106_glyphs_3x[i][0][0], SH1106_font[i], 3u );
+  }
+
+  for( i = 0; i < ARRAY_SIZE(SH1106_fonts); i++ )
+  {
+    scale = i + 1u;
+    font  = &SH1106_fonts[i];
+    memset( SH1106_widths[i], SH1106_DEF_FONT_SIZE * scale, SH1106_FONT_CHARS );
+    font->first   = SH1106_FIRST_CHAR;
+    font->last    = SH1106_LAST_CHAR;
+    font->pages   = scale;
+    font->spacing = scale;
+    font->width   = SH1106_widths[i];
+    OLED_SH1106_FontOffsets( font );
+  }
+  SH1106_fonts[OLED_FONT_5X7].bits    = &SH1106_font[0][0];
+  SH1106_fonts[OLED_FONT_5X7_2X].bits = &SH1106_glyphs_2x[0][0][0];
+  SH1106_fonts[OLED_FONT_5X7_3X].bits = &SH1106_glyphs_3x[0][0][0];
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_FontParse
+ *
+ * Details : Checks a font file (see struct oled_font_header) and sets up
+ *           font to draw from it. The font keeps pointing into data,
+ *           which has to live as long as the font is used.
+ *
+ * Return  : 0 or -EINVAL if the file is malformed
+ ****************************************************************************/
+int OLED_SH1106_FontParse( struct sh1106_font *font, const uint8_t *data, size_t len )
+{
+  const struct oled_font_header *hdr = (const struct oled_font_header *)data;
+  const uint8_t *width = data + sizeof(*hdr);
+  size_t count, size = 0, i;
+
+  if( ( len < sizeof(*hdr) ) || ( memcmp( hdr->magic, "SHF1", 4 ) != 0 ) ||
+      ( hdr->first > hdr->last ) || ( hdr->pages == 0u ) || ( hdr->pages > SH1106_PAGES )
+  )
+  {
+    return( -EINVAL );
+  }
+
+  count = hdr->last - hdr->first + 1u;
+  if( ( len - sizeof(*hdr) ) < count )
+  {
+    return( -EINVAL );
+  }
+  for( i = 0; i < count; i++ )
+  {
+    if( width[i] > SH1106_MAX_SEG )
+    {
+      return( -EINVAL );
+    }
+    size += width[i] * hdr->pages;
+  }
+  // offsets are 16 bits, the last glyph has to start below 64 KiB
+  if( ( size != ( len - sizeof(*hdr) - count ) ) || ( size > 0xFFFFu ) )
+  {
+    return( -EINVAL );
+  }
+
+  font->first   = hdr->first;
+  font->last    = hdr->last;
+  font->pages   = hdr->pages;
+  font->spacing = hdr->spacing;
+  font->width   = width;
+  font->bits    = width + count;
+  OLED_SH1106_FontOffsets( font );
+
+  return( 0 );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_InitPanel
+ *
+ * Details : Prepares a panel whose fb, front, shown and con_text buffers were
+ *           allocated by the transport: the framebuffer is clean, the
+ *           console is empty and the DC level is unknown.
+ ****************************************************************************/
+void OLED_SH1106_InitPanel( struct sh1106_panel *panel, const struct sh1106_bus_ops *ops )
+{
+  unsigned int i;
+
+  panel->ops = ops;
+  panel->dc_state = -1;
+  for( i = 0; i < ARRAY_SIZE(SH1106_fonts); i++ )
+  {
+    panel->fonts[i] = &SH1106_fonts[i];
+  }
+  panel->xfer_cost = SH1106_XFER_COST;
+  panel->reset_assert_us   = SH1106_RESET_US;
+  panel->reset_deassert_us = SH1106_RESET_WAIT_US;
+  panel->contrast = SH1106_CONTRAST;
+  memset( panel->dirty, 0, sizeof(panel->dirty) );
+  memset( panel->con_text, ' ', SH1106_CON_LINES * SH1106_CON_COLS );
+}
+
+
+static void OLED_SH1106_BusLock( struct sh1106_panel *panel )
+{
+  if( panel->ops->lock )
+  {
+    panel->ops->lock( panel );
+  }
+}
+
+
+static void OLED_SH1106_BusUnlock( struct sh1106_panel *panel )
+{
+  if( panel->ops->unlock )
+  {
+    panel->ops->unlock( panel );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_WriteBuf
+ *
+ * Details : Sends a run of command or data bytes in a single bus
+ *           transfer, called with the bus lock held. The DC line is only
+ *           driven when the mode differs from the previous transfer.
+ *
+ * Argument:
+ *              is_cmd -> true for commands, false for display data
+ *              buf    -> DMA-safe buffer
+ *              len    -> Number of bytes
+ * 
+ ****************************************************************************/
+static int OLED_SH1106_WriteBuf( struct sh1106_panel *panel, bool is_cmd, const uint8_t *buf, size_t len )
+{
+  //DC pin has to be low for commands and high for data.
+  int dc = is_cmd ? 0 : 1;
+  int ret;
+
+  if( panel->ready == false )
+  {
+    return( -ENODEV );   // panel not initialised
+  }
+
+  if( panel->dc_state != dc )
+  {
+    // I2C has no DC line, the control byte of each message selects the mode
+    if( panel->ops->set_dc )
+    {
+      panel->ops->set_dc( panel, dc );
+      panel->stats.dc_toggles++;
+    }
+    panel->dc_state = dc;
+  }
+  
+  //send the bytes
+  ret = panel->ops->write( panel, buf, len );
+
+  panel->stats.transfers++;
+  if( ret < 0 )
+  {
+    panel->stats.errors++;
+  }
+  else if( is_cmd )
+  {
+    panel->stats.cmd_bytes += len;
+  }
+  else
+  {
+    panel->stats.data_bytes += len;
+  }
+  
+  return( ret );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_WriteCmds
+ *
+ * Details : Sends a sequence of commands in one transfer. The commands
+ *           are copied into the DMA-safe bounce buffer first, so callers
+ *           may pass constants or stack arrays.
+ ****************************************************************************/
+int OLED_SH1106_WriteCmds( struct sh1106_panel *panel, const uint8_t *cmds, size_t len )
+{
+  int ret;
+
+  if( len > SH1106_CMD_BUF_SIZE )
+  {
+    return( -EINVAL );
+  }
+  
+  OLED_SH1106_BusLock( panel );
+  memcpy( panel->cmd_buf, cmds, len );
+  ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, len );
+  OLED_SH1106_BusUnlock( panel );
+  
+  return( ret );
+}
+
+
+/****************************************************************************
+ * Name: OLED_SH1106_SetCols
+ *
+ * Details : Sets the bits of columns col - last in a column bitmap.
+ ****************************************************************************/
+static void OLED_SH1106_SetCols( uint32_t *map, unsigned int col, unsigned int last )
+{
+  while( col <= last )
+  {
+    unsigned int bit = col % 32u;
+    unsigned int n   = ( ( last - col + 1u ) < ( 32u - bit ) ) ? ( last - col + 1u ) : ( 32u - bit );
+
+    map[col / 32u] |= ( ( n == 32u ) ? 0xFFFFFFFFu : ( ( ( 1u << n ) - 1u ) << bit ) );
+    col += n;
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_NextRun
+ *
+ * Details : Finds the next run of set bits in a column bitmap.
+ *
+ * Argument:
+ *              from -> Column to start searching at
+ *              lo   -> Returns the first column of the run
+ *              hi   -> Returns the last column of the run
+ *
+ * Return  : false when there is no set bit at or after from
+ ****************************************************************************/
+static bool OLED_SH1106_NextRun( const uint32_t *map, unsigned int from, uint8_t *lo, uint8_t *hi )
+{
+  unsigned int col = from;
+
+  // skip clear columns, a whole word at a time where possible
+  while( ( col < SH1106_MAX_SEG ) && ( ( map[col / 32u] >> ( col % 32u ) ) == 0u ) )
+  {
+    col = ( col / 32u + 1u ) * 32u;
+  }
+  while( ( col < SH1106_MAX_SEG ) && ( ( map[col / 32u] & ( 1u << ( col % 32u ) ) ) == 0u ) )
+  {
+    col++;
+  }
+  if( col >= SH1106_MAX_SEG )
+  {
+    return( false );
+  }
+
+  *lo = col;
+  while( ( col < SH1106_MAX_SEG ) && ( map[col / 32u] & ( 1u << ( col % 32u ) ) ) )
+  {
+    col++;
+  }
+  *hi = col - 1u;
+
+  return( true );
+}
+
+
+static bool OLED_SH1106_PageDirty( const uint32_t *map )
+{
+  unsigned int i;
+
+  for( i = 0; i < SH1106_DIRTY_WORDS; i++ )
+  {
+    if( map[i] != 0u )
+    {
+      return( true );
+    }
+  }
+
+  return( false );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_MarkSpan
+ *
+ * Details : Marks a column span of a RAM page as dirty so that the next
+ *           OLED_SH1106_Flush() sends it.
+ *
+ * Argument:
+ *              page -> RAM page number
+ *              col  -> First changed column
+ *              last -> Last changed column
+ * 
+ ****************************************************************************/
+static void OLED_SH1106_MarkSpan( struct sh1106_panel *panel, uint8_t page, uint8_t col, uint8_t last )
+{
+  OLED_SH1106_SetCols( panel->dirty[page], col, last );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_MarkRows
+ *
+ * Details : Marks columns of a band of screen rows as dirty. The rows are
+ *           translated through the start line, so the band covers one
+ *           RAM page more than on the screen when the start line is not
+ *           a multiple of 8.
+ *
+ * Argument:
+ *              y    -> First screen row, 0 - 63
+ *              h    -> Number of rows, 1 - 64
+ *              col  -> First changed column
+ *              len  -> Number of changed columns
+ * 
+ ****************************************************************************/
+static void OLED_SH1106_MarkRows( struct sh1106_panel *panel, unsigned int y, unsigned int h,
+                                  uint8_t col, unsigned int len )
+{
+  unsigned int first, count, i;
+  uint8_t last;
+
+  if( ( len == 0u ) || ( h == 0u ) || ( col >= SH1106_MAX_SEG ) )
+  {
+    return;
+  }
+
+  last = ( ( col + len ) > SH1106_MAX_SEG ) ? ( SH1106_MAX_SEG - 1 ) : ( col + len - 1 );
+
+  y     = ( y + panel->start_line ) % OLED_SH1106_HEIGHT;
+  first = y / 8;
+  count = ( ( y + h - 1 ) / 8 ) - first + 1;
+  if( count > SH1106_PAGES )
+  {
+    count = SH1106_PAGES;
+  }
+
+  for( i = 0; i < count; i++ )
+  {
+    OLED_SH1106_MarkSpan( panel, ( first + i ) & SH1106_MAX_LINE, col, last );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_MarkDirty
+ *
+ * Details : Marks a column span of a text line (screen page) as dirty.
+ *
+ * Argument:
+ *              page -> Page (line) number on the screen
+ *              col  -> First changed column
+ *              len  -> Number of changed columns
+ * 
+ ****************************************************************************/
+static void OLED_SH1106_MarkDirty( struct sh1106_panel *panel, uint8_t page, uint8_t col, unsigned int len )
+{
+  OLED_SH1106_MarkRows( panel, page * 8u, 8u, col, len );
+}
+
+
+static void OLED_SH1106_MarkAllDirty( struct sh1106_panel *panel )
+{
+  memset(panel->dirty, 0xFF, sizeof(panel->dirty));
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_MarkRect
+ *
+ * Details : Marks a pixel rectangle as dirty, e.g. after userspace drew
+ *           into the mmap()ed framebuffer. The rectangle is clipped to
+ *           the screen, a zero width or height marks the whole screen.
+ *
+ * Argument:
+ *              x, y          -> Top left corner in pixels
+ *              width, height -> Size in pixels
+ * 
+ ****************************************************************************/
+void OLED_SH1106_MarkRect( struct sh1106_panel *panel, uint8_t x, uint8_t y, uint8_t width, uint8_t height )
+{
+  unsigned int rows;
+
+  if( ( width == 0u ) || ( height == 0u ) )
+  {
+    OLED_SH1106_MarkAllDirty(panel);
+    return;
+  }
+
+  if( ( x >= SH1106_MAX_SEG ) || ( y >= OLED_SH1106_HEIGHT ) )
+  {
+    return;
+  }
+
+  rows = ( ( y + height ) > OLED_SH1106_HEIGHT ) ? ( OLED_SH1106_HEIGHT - y ) : height;
+  OLED_SH1106_MarkRows( panel, y, rows, x, width );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_SetCursor
+ *
+ * Details : Moves the text cursor. Nothing is sent to the panel, the
+ *           next character is rendered into the framebuffer at this
+ *           position.
+ *
+ * Argument:
+ *              lineNo    -> Line Number
+ *              cursorPos -> Cursor Position
+ * 
+ ****************************************************************************/
+void OLED_SH1106_SetCursor( struct sh1106_panel *panel, uint8_t lineNo, uint8_t cursorPos )
+{
+  panel->line_num   = ( lineNo & SH1106_MAX_LINE );
+  panel->cursor_pos = ( cursorPos < SH1106_MAX_SEG ) ? cursorPos : 0u;
+}
+
+
+void OLED_SH1106_GoToNextLine( struct sh1106_panel *panel )
+{
+
+  panel->line_num += panel->fonts[panel->font]->pages;   // text lines are as high as the font
+  panel->line_num = (panel->line_num & SH1106_MAX_LINE);
+  OLED_SH1106_SetCursor(panel, panel->line_num,0); /* Finally move it to next line */
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Glyph
+ *
+ * Details : Looks a character up in a font. Characters the font lacks
+ *           become '?', NULL if that is missing too.
+ ****************************************************************************/
+static const uint8_t *OLED_SH1106_Glyph( const struct sh1106_font *font, unsigned char c, unsigned int *width )
+{
+  unsigned int i;
+
+  if( ( c < font->first ) || ( c > font->last ) || ( font->width[c - font->first] == 0u ) )
+  {
+    c = '?';
+    if( ( c < font->first ) || ( c > font->last ) || ( font->width[c - font->first] == 0u ) )
+    {
+      return( NULL );
+    }
+  }
+
+  i = c - font->first;
+  *width = font->width[i];
+  return( font->bits + font->offset[i] );
+}
+
+// Marks the columns from start to the cursor on every page of the text line
+static void OLED_SH1106_MarkText( struct sh1106_panel *panel, const struct sh1106_font *font, uint8_t start )
+{
+  unsigned int pages = ( ( panel->line_num + font->pages ) > SH1106_PAGES ) ? ( SH1106_PAGES - panel->line_num ) : font->pages;
+
+  OLED_SH1106_MarkRows( panel, panel->line_num * 8u, pages * 8u, start, panel->cursor_pos - start );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Text
+ *
+ * Details : Renders a run of characters into the framebuffer in one
+ *           pass with the current font. Each character is a copy of its
+ *           glyph per page, and the changed part of every line is marked
+ *           dirty once, so the whole string goes out as one span per
+ *           page. Characters outside the font are shown as '?'. Glyphs
+ *           are clipped at the right and bottom edge of the screen.
+ * 
+ * Arguments:
+ *           str -> characters to be written, need not be terminated
+ *           len -> number of characters
+ * 
+ ****************************************************************************/
+void OLED_SH1106_Text( struct sh1106_panel *panel, const char *str, size_t len )
+{
+  const struct sh1106_font *font = panel->fonts[panel->font];
+  uint8_t start = panel->cursor_pos;
+  unsigned int width = 0, room, cols, gap, page;
+  const uint8_t *glyph = NULL;
+  unsigned char c;
+  size_t i;
+
+  for( i = 0; i < len; i++ )
+  {
+    c = str[i];
+
+    if( c != '\n' )
+    {
+      glyph = OLED_SH1106_Glyph( font, c, &width );
+      if( glyph == NULL )
+      {
+        continue;
+      }
+    }
+
+    if( (( panel->cursor_pos > 0u ) &&
+         (( panel->cursor_pos + width + font->spacing ) > SH1106_MAX_SEG )) ||
+        ( c == '\n' )
+    )
+    {
+      OLED_SH1106_MarkText( panel, font, start );
+      OLED_SH1106_GoToNextLine(panel);
+      start = 0;
+      
+      if( c == '\n' )
+      {
+        continue;
+      }
+    }
+
+    room = SH1106_MAX_SEG - panel->cursor_pos;
+    cols = ( width > room ) ? room : width;
+    gap  = ( font->spacing > ( room - cols ) ) ? ( room - cols ) : font->spacing;
+    for( page = 0; ( page < font->pages ) && ( ( panel->line_num + page ) < SH1106_PAGES ); page++ )
+    {
+      memcpy( &panel->fb[panel->line_num + page][panel->cursor_pos], glyph + page * width, cols );
+      memset( &panel->fb[panel->line_num + page][panel->cursor_pos + cols], 0x00, gap );
+    }
+    panel->cursor_pos += cols + gap;
+  }
+
+  OLED_SH1106_MarkText( panel, font, start );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_SetFont
+ *
+ * Details : Selects the font slot used by the text functions.
+ *
+ * Return  : 0 or -EINVAL if the slot is empty
+ ****************************************************************************/
+int OLED_SH1106_SetFont( struct sh1106_panel *panel, unsigned int slot )
+{
+  if( ( slot >= OLED_FONT_SLOTS ) || ( panel->fonts[slot] == NULL ) )
+  {
+    return( -EINVAL );
+  }
+
+  panel->font = slot;
+  return( 0 );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_PrintChar
+ *
+ * Details : Renders a single character with the current font at the
+ *           text cursor into the framebuffer, like OLED_SH1106_Text().
+ * 
+ * Arguments:
+ *           c   -> character to be written
+ * 
+ ****************************************************************************/
+void OLED_SH1106_PrintChar( struct sh1106_panel *panel, unsigned char c )
+{
+  OLED_SH1106_Text( panel, (const char *)&c, 1 );
+}
+
+
+void OLED_SH1106_String(struct sh1106_panel *panel, char *str)
+{
+  OLED_SH1106_Text( panel, str, strlen( str ) );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ConsoleLine
+ *
+ * Details : Returns the console text shown on a screen line, taking the
+ *           scrollback view into account.
+ ****************************************************************************/
+static char *OLED_SH1106_ConsoleLine( struct sh1106_panel *panel, uint8_t row )
+{
+  unsigned int line = panel->con_top + SH1106_CON_LINES - panel->con_view + row;
+
+  return( panel->con_text[line % SH1106_CON_LINES] );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ConsoleNewLine
+ *
+ * Details : Moves the console cursor to the start of the next line. On
+ *           the last screen line the console scrolls by one line: the
+ *           oldest line becomes scrollback and a blank line is added.
+ ****************************************************************************/
+static void OLED_SH1106_ConsoleNewLine( struct sh1106_panel *panel )
+{
+  panel->con_col = 0u;
+
+  if( panel->con_row < SH1106_MAX_LINE )
+  {
+    panel->con_row++;
+    return;
+  }
+
+  panel->con_top = ( panel->con_top + 1u ) % SH1106_CON_LINES;
+  memset( panel->con_text[( panel->con_top + SH1106_MAX_LINE ) % SH1106_CON_LINES], ' ', SH1106_CON_COLS );
+
+  if( panel->con_used < ( SH1106_CON_LINES - SH1106_PAGES ) )
+  {
+    panel->con_used++;
+  }
+  if( ( panel->con_view != 0u ) && ( panel->con_view < panel->con_used ) )
+  {
+    panel->con_view++;   // keep the scrollback view on the same lines
+  }
+
+  // the dirty lines move up with the text, the new line is blank
+  panel->con_scroll++;
+  panel->con_dirty = ( panel->con_dirty >> 1 ) | ( 1u << SH1106_MAX_LINE );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ConsoleWrite
+ *
+ * Details : Feeds characters to the console. Only the text is updated
+ *           here, OLED_SH1106_ConsoleRender() draws the result, so a
+ *           long write costs one render however many lines it scrolls.
+ *           Understood control characters are '\n', '\r', '\b', '\t' and
+ *           '\f' (clear), other control characters are ignored.
+ * 
+ * Arguments:
+ *           buf -> characters, need not be terminated
+ *           len -> number of characters
+ * 
+ ****************************************************************************/
+void OLED_SH1106_ConsoleWrite( struct sh1106_panel *panel, const char *buf, size_t len )
+{
+  unsigned char c;
+  size_t i;
+
+  for( i = 0; i < len; i++ )
+  {
+    c = buf[i];
+
+    switch( c )
+    {
+      case '\n':
+        OLED_SH1106_ConsoleNewLine(panel);
+        break;
+      case '\r':
+        panel->con_col = 0u;
+        break;
+      case '\b':
+        if( panel->con_col > 0u )
+        {
+          panel->con_col--;
+        }
+        break;
+      case '\t':
+        panel->con_col = ( ( panel->con_col / SH1106_CON_TAB ) + 1u ) * SH1106_CON_TAB;
+        if( panel->con_col > SH1106_CON_COLS )
+        {
+          panel->con_col = SH1106_CON_COLS;   // wraps with the next character
+        }
+        break;
+      case '\f':
+        memset( panel->con_text, ' ', SH1106_CON_LINES * SH1106_CON_COLS );
+        panel->con_top    = 0u;
+        panel->con_row    = 0u;
+        panel->con_col    = 0u;
+        panel->con_used   = 0u;
+        panel->con_view   = 0u;
+        panel->con_scroll = 0u;
+        panel->con_dirty  = 0xFF;
+        break;
+      default:
+        if( ( c < SH1106_FIRST_CHAR ) || ( c == 0x7F ) )
+        {
+          break;   // unsupported control character
+        }
+        if( panel->con_col >= SH1106_CON_COLS )
+        {
+          OLED_SH1106_ConsoleNewLine(panel);
+        }
+        panel->con_text[( panel->con_top + panel->con_row ) % SH1106_CON_LINES][panel->con_col++] = c;
+        panel->con_dirty |= ( 1u << panel->con_row );
+        break;
+    }
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ConsoleDraw
+ *
+ * Details : Renders the console lines flagged in con_dirty into the
+ *           framebuffer.
+ ****************************************************************************/
+static void OLED_SH1106_ConsoleDraw( struct sh1106_panel *panel )
+{
+  const char *text;
+  unsigned char c;
+  uint8_t row, i;
+
+  for( row = 0; row < SH1106_PAGES; row++ )
+  {
+    if( ( panel->con_dirty & ( 1u << row ) ) == 0u )
+    {
+      continue;
+    }
+
+    text = OLED_SH1106_ConsoleLine( panel, row );
+    for( i = 0; i < SH1106_CON_COLS; i++ )
+    {
+      c = text[i];
+      if( c > SH1106_LAST_CHAR )
+      {
+        c = '?';
+      }
+      memcpy( &panel->fb[row][i * SH1106_GLYPH_WIDTH],
+              SH1106_glyphs[c - SH1106_FIRST_CHAR], SH1106_GLYPH_WIDTH );
+    }
+    memset( &panel->fb[row][SH1106_CON_COLS * SH1106_GLYPH_WIDTH], 0x00,
+            SH1106_MAX_SEG - ( SH1106_CON_COLS * SH1106_GLYPH_WIDTH ) );
+    OLED_SH1106_MarkDirty( panel, row, 0u, SH1106_MAX_SEG );
+  }
+
+  panel->con_dirty = 0u;
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ConsoleRender
+ *
+ * Details : Brings the framebuffer up to date with the console after
+ *           OLED_SH1106_ConsoleWrite(). Lines scrolled since the last
+ *           render are applied with one hardware scroll, so only lines
+ *           whose text changed are redrawn. Nothing is drawn while the
+ *           scrollback is shown.
+ ****************************************************************************/
+void OLED_SH1106_ConsoleRender( struct sh1106_panel *panel )
+{
+  if( panel->con_view != 0u )
+  {
+    return;
+  }
+
+  if( panel->con_scroll >= SH1106_PAGES )
+  {
+    panel->con_dirty = 0xFF;
+  }
+  else if( panel->con_scroll > 0u )
+  {
+    OLED_SH1106_Scroll( panel, panel->con_scroll * 8 );
+  }
+  panel->con_scroll = 0u;
+
+  OLED_SH1106_ConsoleDraw(panel);
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ConsoleView
+ *
+ * Details : Shows the console scrollback. Output written meanwhile is
+ *           kept and appears when the view returns to 0.
+ * 
+ * Arguments:
+ *           lines -> lines to look back, 0 shows the live console
+ * 
+ ****************************************************************************/
+void OLED_SH1106_ConsoleView( struct sh1106_panel *panel, int lines )
+{
+  if( lines < 0 )
+  {
+    lines = 0;
+  }
+  if( lines > panel->con_used )
+  {
+    lines = panel->con_used;
+  }
+
+  panel->con_view   = lines;
+  panel->con_scroll = 0u;
+  panel->con_dirty  = 0xFF;
+  OLED_SH1106_ConsoleDraw(panel);
+}
+
+
+
+/****************************************************************************
+ * Name: OLED_SH1106_InvertDisplay
+ *
+ * Details : Switches between normal and inverted display. The state is
+ *           kept, so OLED_SH1106_Wake() can set it again after a power
+ *           loss.
+ ****************************************************************************/
+void OLED_SH1106_InvertDisplay(struct sh1106_panel *panel, bool need_to_invert)
+{
+  OLED_SH1106_BusLock( panel );
+  if(need_to_invert)
+  {
+    panel->cmd_buf[0] = 0xA7; // Invert the display
+  }
+  else
+  {
+    panel->cmd_buf[0] = 0xA6; // Normal display
+  }
+  if( OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, 1 ) >= 0 )
+  {
+    panel->inverted = need_to_invert;
+  }
+  OLED_SH1106_BusUnlock( panel );
+}
+
+
+/****************************************************************************
+ * Name: OLED_SH1106_SetBrightness
+ *
+ * Details : Sets the contrast. The value is kept, so OLED_SH1106_Wake()
+ *           can set it again after a power loss.
+ ****************************************************************************/
+void OLED_SH1106_SetBrightness(struct sh1106_panel *panel, uint8_t brightnessValue)
+{
+    OLED_SH1106_BusLock( panel );
+    panel->cmd_buf[0] = 0x81;             // Contrast command
+    panel->cmd_buf[1] = brightnessValue;  // Contrast value (default value = 0x7F)
+    if( OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, 2 ) >= 0 )
+    {
+      panel->contrast = brightnessValue;
+    }
+    OLED_SH1106_BusUnlock( panel );
+}
+
+
+
+
+
+void OLED_SH1106_fill( struct sh1106_panel *panel, uint8_t data )
+{
+  // 8 pages x 128 segments x 8 bits of data
+  memset( panel->fb, data, OLED_SH1106_FB_SIZE );
+  OLED_SH1106_MarkAllDirty(panel);
+}
+
+
+void OLED_SH1106_ClearDisplay( struct sh1106_panel *panel )
+{
+  //Set cursor
+  OLED_SH1106_SetCursor(panel, 0,0);
+  
+  OLED_SH1106_fill( panel, 0x00 );
+}
+
+
+void OLED_SH1106_PrintLogo( struct sh1106_panel *panel )
+{
+  //Set cursor
+  OLED_SH1106_SetCursor(panel, 0,0);
+  
+  memcpy( panel->fb, OLED_logo, OLED_SH1106_FB_SIZE );
+  OLED_SH1106_MarkAllDirty(panel);
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Blit
+ *
+ * Details : Copies a page aligned bitmap into the framebuffer, clipped
+ *           at the screen edges.
+ *
+ * Argument:
+ *              x, y -> Top left corner in pixels, y is a multiple of 8
+ *              w, h -> Size in pixels, h is a multiple of 8
+ *              src  -> h / 8 rows of w bytes in framebuffer layout
+ * 
+ ****************************************************************************/
+void OLED_SH1106_Blit( struct sh1106_panel *panel, int x, int y, int w, int h, const uint8_t *src )
+{
+  int row, page, x0, x1;
+
+  x0 = ( x < 0 ) ? 0 : x;
+  x1 = ( ( x + w ) > SH1106_MAX_SEG ) ? SH1106_MAX_SEG : ( x + w );
+  if( x0 >= x1 )
+  {
+    return;
+  }
+
+  for( row = 0; row < ( h / 8 ); row++ )
+  {
+    page = ( y / 8 ) + row;
+    if( ( page < 0 ) || ( page >= SH1106_PAGES ) )
+    {
+      continue;
+    }
+
+    memcpy( &panel->fb[page][x0], &src[( row * w ) + ( x0 - x )], x1 - x0 );
+    OLED_SH1106_MarkDirty( panel, page, x0, x1 - x0 );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_BlitRop
+ *
+ * Details : Combines a bitmap with the framebuffer at any pixel position.
+ *           Every column is handled as one 64 bit word: the source bytes
+ *           of the column are shifted into place, the destination pages
+ *           they cover are gathered into a word as well, the raster op
+ *           is applied under the mask of the visible rows and the pages
+ *           are written back. Page aligned copies use OLED_SH1106_Blit().
+ *
+ * Argument:
+ *              x, y -> Top left corner in pixels
+ *              w, h -> Size in pixels
+ *              src  -> ( h + 7 ) / 8 rows of w bytes in framebuffer layout
+ *              rop  -> OLED_ROP_*
+ * 
+ ****************************************************************************/
+void OLED_SH1106_BlitRop( struct sh1106_panel *panel, int x, int y, int w, int h, const uint8_t *src, uint8_t rop )
+{
+  int x0 = ( x < 0 ) ? 0 : x;
+  int x1 = ( ( x + w ) > SH1106_MAX_SEG ) ? SH1106_MAX_SEG : ( x + w );
+  int y0 = ( y < 0 ) ? 0 : y;
+  int y1 = ( ( y + h ) > OLED_SH1106_HEIGHT ) ? OLED_SH1106_HEIGHT : ( y + h );
+  int p0, p1, pg, col, page;
+  uint64_t mask, s, d;
+
+  if( ( w <= 0 ) || ( h <= 0 ) || ( x0 >= x1 ) || ( y0 >= y1 ) )
+  {
+    return;
+  }
+
+  if( ( rop == OLED_ROP_COPY ) && ( ( y % 8 ) == 0 ) && ( ( h % 8 ) == 0 ) )
+  {
+    OLED_SH1106_Blit( panel, x, y, w, h, src );
+    return;
+  }
+
+  // visible rows, on the screen and in the source
+  mask = ( ( y1 - y0 ) == 64 ) ? ~0ULL : ( ( ( 1ULL << ( y1 - y0 ) ) - 1u ) << y0 );
+  p0   = ( y0 - y ) / 8;          // source pages that reach the screen
+  p1   = ( y1 - 1 - y ) / 8;
+
+  for( col = x0; col < x1; col++ )
+  {
+    const uint8_t *in = &src[col - x];
+    int shift;
+
+    s = 0u;
+    for( page = p0; page <= p1; page++ )
+    {
+      shift = y + ( page * 8 );
+      s |= ( shift >= 0 ) ? ( (uint64_t)in[page * w] << shift ) : ( (uint64_t)in[page * w] >> -shift );
+    }
+
+    d = 0u;
+    for( pg = y0 / 8; pg <= ( y1 - 1 ) / 8; pg++ )
+    {
+      d |= (uint64_t)panel->fb[pg][col] << ( pg * 8 );
+    }
+
+    switch( rop )
+    {
+      case OLED_ROP_OR:
+        d |= s & mask;
+        break;
+      case OLED_ROP_AND:
+        d &= s | ~mask;
+        break;
+      case OLED_ROP_XOR:
+        d ^= s & mask;
+        break;
+      default:
+        d = ( d & ~mask ) | ( s & mask );
+        break;
+    }
+
+    for( pg = y0 / 8; pg <= ( y1 - 1 ) / 8; pg++ )
+    {
+      panel->fb[pg][col] = (uint8_t)( d >> ( pg * 8 ) );
+    }
+  }
+
+  OLED_SH1106_MarkRows( panel, y0, y1 - y0, x0, x1 - x0 );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Transpose8
+ *
+ * Details : Transposes an 8 x 8 bit block. Byte 7 - r of the input is row
+ *           r with its leftmost pixel in bit 7; byte 7 - c of the result
+ *           is column c with row r in bit r, as in the framebuffer.
+ ****************************************************************************/
+static uint64_t OLED_SH1106_Transpose8( uint64_t x )
+{
+  uint64_t t;
+
+  t = ( x ^ ( x >> 7 ) ) & 0x00AA00AA00AA00AAULL;
+  x = x ^ t ^ ( t << 7 );
+  t = ( x ^ ( x >> 14 ) ) & 0x0000CCCC0000CCCCULL;
+  x = x ^ t ^ ( t << 14 );
+  t = ( x ^ ( x >> 28 ) ) & 0x00000000F0F0F0F0ULL;
+  x = x ^ t ^ ( t << 28 );
+
+  return( x );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Image
+ *
+ * Details : Combines a linear 1 bpp image with the framebuffer, e.g. a
+ *           widget rendered by userspace. For every page the image
+ *           covers, the source rows falling into it are read a byte at a
+ *           time and transposed in blocks of 8 x 8 pixels into page
+ *           format. Only the rectangle is marked dirty, so the flush
+ *           sends just its page/column spans.
+ *
+ * Argument:
+ *              x, y   -> Top left corner in pixels
+ *              w, h   -> Size in pixels
+ *              src    -> h rows of stride bytes, leftmost pixel in bit 7,
+ *                        a set bit is a lit pixel
+ *              stride -> Bytes per source row, at least ( w + 7 ) / 8
+ *              rop    -> OLED_ROP_*
+ * 
+ ****************************************************************************/
+void OLED_SH1106_Image( struct sh1106_panel *panel, int x, int y, int w, int h,
+                        const uint8_t *src, size_t stride, uint8_t rop )
+{
+  int x0 = ( x < 0 ) ? 0 : x;
+  int x1 = ( ( x + w ) > SH1106_MAX_SEG ) ? SH1106_MAX_SEG : ( x + w );
+  int y0 = ( y < 0 ) ? 0 : y;
+  int y1 = ( ( y + h ) > OLED_SH1106_HEIGHT ) ? OLED_SH1106_HEIGHT : ( y + h );
+  int page, row, lo, hi, blk, c, col;
+  uint8_t mask, s, *d;
+  uint64_t bits;
+
+  if( ( w <= 0 ) || ( h <= 0 ) || ( x0 >= x1 ) || ( y0 >= y1 ) )
+  {
+    return;
+  }
+
+  for( page = y0 / 8; page <= ( y1 - 1 ) / 8; page++ )
+  {
+    // rows of the page inside the image and on the screen
+    lo   = ( ( page * 8 ) < y0 ) ? ( y0 - page * 8 ) : 0;
+    hi   = ( ( page * 8 + 8 ) > y1 ) ? ( y1 - page * 8 ) : 8;
+    mask = (uint8_t)( ( 0xFFu << lo ) & ( 0xFFu >> ( 8 - hi ) ) );
+
+    // source bytes holding the visible columns
+    for( blk = ( x0 - x ) / 8; blk <= ( x1 - 1 - x ) / 8; blk++ )
+    {
+      bits = 0u;
+      for( row = 7; row >= 0; row-- )
+      {
+        bits <<= 8;
+        if( mask & ( 1u << row ) )
+        {
+          bits |= src[(size_t)( page * 8 + row - y ) * stride + blk];
+        }
+      }
+      bits = OLED_SH1106_Transpose8( bits );
+
+      for( c = 0; c < 8; c++ )
+      {
+        col = x + blk * 8 + c;
+        if( ( col < x0 ) || ( col >= x1 ) )
+        {
+          continue;
+        }
+        s = (uint8_t)( bits >> ( 56 - c * 8 ) );
+        d = &panel->fb[page][col];
+        switch( rop )
+        {
+          case OLED_ROP_OR:
+            *d |= s & mask;
+            break;
+          case OLED_ROP_AND:
+            *d &= s | (uint8_t)~mask;
+            break;
+          case OLED_ROP_XOR:
+            *d ^= s & mask;
+            break;
+          default:
+            *d = ( *d & (uint8_t)~mask ) | ( s & mask );
+            break;
+        }
+      }
+    }
+  }
+
+  OLED_SH1106_MarkRows( panel, y0, y1 - y0, x0, x1 - x0 );
+}
+
+// Ordered dither thresholds, 0 - 63 in an 8 x 8 Bayer pattern
+static const uint8_t SH1106_bayer8[8][8] =
+{
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+/****************************************************************************
+ * Name: OLED_SH1106_GrayRow
+ *
+ * Details : Converts w source pixels to luminance. XRGB8888 uses the
+ *           BT.601 weights in 8 bit fixed point, which add up to 256.
+ ****************************************************************************/
+static void OLED_SH1106_GrayRow( uint8_t *gray, const uint8_t *src, int w, uint8_t format )
+{
+  int i;
+
+  if( format == OLED_PIXEL_XRGB8888 )
+  {
+    for( i = 0; i < w; i++ )
+    {
+      gray[i] = (uint8_t)( ( src[i * 4 + 2] * 77u + src[i * 4 + 1] * 150u + src[i * 4] * 29u ) >> 8 );
+    }
+  }
+  else
+  {
+    memcpy( gray, src, w );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Pixels
+ *
+ * Details : Stores a grayscale or XRGB8888 image as 1 bpp, e.g. a surface
+ *           of a UI toolkit. Works in bands of 8 rows: each row is
+ *           turned into luminance, compared against a threshold per
+ *           pixel and packed into a linear 1 bpp row, and the band goes
+ *           through OLED_SH1106_Image(), which transposes it into page
+ *           format. Threshold and ordered dither share the comparison,
+ *           with the 8 thresholds of a row repeating every 8 pixels, so
+ *           the inner loop is branch free. Floyd-Steinberg keeps the
+ *           error of the next row in a single buffer that it rewrites
+ *           as it moves along the current one.
+ *
+ * Argument:
+ *              x, y   -> Top left corner in pixels
+ *              w, h   -> Size in pixels, w at most SH1106_MAX_SEG
+ *              src    -> h rows of stride bytes
+ *              stride -> Bytes per source row
+ *              format -> OLED_PIXEL_*
+ *              dither -> OLED_DITHER_*
+ *              level  -> Threshold of OLED_DITHER_THRESHOLD, 0 for 128
+ * 
+ ****************************************************************************/
+void OLED_SH1106_Pixels( struct sh1106_panel *panel, int x, int y, int w, int h, const uint8_t *src,
+                         size_t stride, uint8_t format, uint8_t dither, uint8_t level )
+{
+  uint8_t bits[8][SH1106_MAX_SEG / 8];
+  uint8_t gray[SH1106_MAX_SEG];
+  int16_t err[SH1106_MAX_SEG + 2];   // err[i + 1]: error carried to pixel i
+  uint8_t thr[8];
+  int band, row, rows, i, k, v, e, right, below;
+  uint8_t b;
+
+  if( ( w <= 0 ) || ( h <= 0 ) || ( w > SH1106_MAX_SEG ) )
+  {
+    return;
+  }
+
+  memset( err, 0, sizeof(err) );
+  memset( gray, 0, sizeof(gray) );
+  for( band = 0; band < h; band += 8 )
+  {
+    rows = ( ( h - band ) < 8 ) ? ( h - band ) : 8;
+    for( row = 0; row < rows; row++ )
+    {
+      OLED_SH1106_GrayRow( gray, src + (size_t)( band + row ) * stride, w, format );
+
+      if( dither == OLED_DITHER_FLOYD_STEINBERG )
+      {
+        right = 0;
+        below = 0;
+        b = 0u;
+        for( i = 0; i < w; i++ )
+        {
+          v = gray[i] + err[i + 1] + right;
+          e = ( v >= 128 ) ? ( v - 255 ) : v;
+          b = (uint8_t)( ( b << 1 ) | ( v >= 128 ) );
+          if( ( i & 7 ) == 7 )
+          {
+            bits[row][i / 8] = b;
+          }
+          // 7/16 right, 3/16 below left, 5/16 below, 1/16 below right
+          right       = e * 7 / 16;
+          err[i]     += e * 3 / 16;
+          err[i + 1]  = e * 5 / 16 + below;
+          below       = e / 16;
+        }
+        if( w & 7 )
+        {
+          bits[row][w / 8] = (uint8_t)( b << ( 8 - ( w & 7 ) ) );
+        }
+        err[0] = 0;
+      }
+      else
+      {
+        for( k = 0; k < 8; k++ )
+        {
+          // lit where gray > thr, the ordered thresholds spread 2 - 254
+          thr[k] = ( dither == OLED_DITHER_ORDERED ) ?
+                   (uint8_t)( SH1106_bayer8[( y + band + row ) & 7][( x + k ) & 7] * 4 + 2 ) :
+                   (uint8_t)( ( level ? level : 128 ) - 1 );
+        }
+        for( i = 0; i < w; i += 8 )
+        {
+          b = 0u;
+          for( k = 0; k < 8; k++ )
+          {
+            b |= (uint8_t)( ( gray[i + k] > thr[k] ) << ( 7 - k ) );
+          }
+          bits[row][i / 8] = b;
+        }
+      }
+    }
+
+    OLED_SH1106_Image( panel, x, y + band, w, rows, &bits[0][0], sizeof(bits[0]), OLED_ROP_COPY );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_UploadSpan
+ *
+ * Details : Writes or XORs n bytes from the framebuffer offset off on and
+ *           marks each page part that changed. src is NULL for a run of
+ *           the single byte value.
+ ****************************************************************************/
+static void OLED_SH1106_UploadSpan( struct sh1106_panel *panel, unsigned int off, unsigned int n,
+                                    const uint8_t *src, uint8_t value, bool xor )
+{
+  while( n > 0u )
+  {
+    unsigned int page = off / SH1106_MAX_SEG;
+    unsigned int col  = off % SH1106_MAX_SEG;
+    unsigned int len  = ( n < ( SH1106_MAX_SEG - col ) ) ? n : ( SH1106_MAX_SEG - col );
+    uint8_t *dst = &panel->fb[page][col];
+    uint8_t changed = 0u;
+    uint8_t b;
+    unsigned int i;
+
+    for( i = 0; i < len; i++ )
+    {
+      b = ( src != NULL ) ? src[i] : value;
+      b = xor ? ( dst[i] ^ b ) : b;
+      changed |= dst[i] ^ b;
+      dst[i] = b;
+    }
+    if( changed != 0u )
+    {
+      OLED_SH1106_MarkDirty( panel, page, col, len );
+    }
+
+    if( src != NULL )
+    {
+      src += len;
+    }
+    off += len;
+    n   -= len;
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Decode
+ *
+ * Details : Walks a compressed frame (see IOCTL_UPLOAD). With a panel the
+ *           spans are decoded into its framebuffer, without one the
+ *           stream is only checked.
+ *
+ * Return  : 0 or -EINVAL if the stream is malformed
+ ****************************************************************************/
+static int OLED_SH1106_Decode( struct sh1106_panel *panel, const uint8_t *data, size_t len, bool xor )
+{
+  unsigned int off = 0, n;
+  size_t pos = 0;
+  uint8_t code;
+
+  while( pos < len )
+  {
+    code = data[pos++];
+    if( code & 0x80 )
+    {
+      n = ( code & 0x7F ) + 1u;
+      if( ( off + n ) > OLED_SH1106_FB_SIZE )
+      {
+        return( -EINVAL );
+      }
+    }
+    else if( code & 0x40 )
+    {
+      n = ( code & 0x3F ) + 2u;
+      if( ( pos >= len ) || ( ( off + n ) > OLED_SH1106_FB_SIZE ) )
+      {
+        return( -EINVAL );
+      }
+      if( panel != NULL )
+      {
+        OLED_SH1106_UploadSpan( panel, off, n, NULL, data[pos], xor );
+      }
+      pos++;
+    }
+    else
+    {
+      n = ( code & 0x3F ) + 1u;
+      if( ( ( pos + n ) > len ) || ( ( off + n ) > OLED_SH1106_FB_SIZE ) )
+      {
+        return( -EINVAL );
+      }
+      if( panel != NULL )
+      {
+        OLED_SH1106_UploadSpan( panel, off, n, &data[pos], 0u, xor );
+      }
+      pos += n;
+    }
+    off += n;
+  }
+
+  return( 0 );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_UploadCheck
+ *
+ * Details : Checks a compressed frame without drawing it, e.g. when it
+ *           is stored for later.
+ *
+ * Return  : 0 or -EINVAL
+ ****************************************************************************/
+int OLED_SH1106_UploadCheck( const uint8_t *data, size_t len, uint8_t format )
+{
+  if( format > OLED_UPLOAD_XOR )
+  {
+    return( -EINVAL );
+  }
+
+  return( OLED_SH1106_Decode( NULL, data, len, false ) );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Upload
+ *
+ * Details : Decodes a compressed frame (see IOCTL_UPLOAD) straight into
+ *           the framebuffer. The stream is checked completely before
+ *           the first byte is written, so a bad stream changes nothing.
+ *           Only page parts whose bytes changed are marked dirty, so
+ *           the flush sends just the decoded spans that differ.
+ *
+ * Argument:
+ *              data   -> Compressed stream
+ *              len    -> Length of the stream
+ *              format -> OLED_UPLOAD_*
+ *
+ * Return  : 0 or -EINVAL
+ ****************************************************************************/
+int OLED_SH1106_Upload( struct sh1106_panel *panel, const uint8_t *data, size_t len, uint8_t format )
+{
+  int ret = OLED_SH1106_UploadCheck( data, len, format );
+
+  if( ret == 0 )
+  {
+    ret = OLED_SH1106_Decode( panel, data, len, format == OLED_UPLOAD_XOR );
+  }
+
+  return( ret );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_MaskCols
+ *
+ * Details : Applies a bit mask to columns x0 - x1 - 1 of a page: the
+ *           pixels of one byte are set, cleared or flipped together.
+ *
+ * Argument:
+ *              page   -> Page (line) number on the screen
+ *              x0, x1 -> First column and the column after the last
+ *              mask   -> Rows of the page to change
+ *              color  -> OLED_COLOR_*
+ ****************************************************************************/
+static void OLED_SH1106_MaskCols( struct sh1106_panel *panel, int page, int x0, int x1, uint8_t mask, uint8_t color )
+{
+  uint8_t *col = &panel->fb[page][x0];
+  uint8_t *end = &panel->fb[page][x1];
+
+  switch( color )
+  {
+    case OLED_COLOR_BLACK:
+      for( ; col < end; col++ )
+      {
+        *col &= (uint8_t)~mask;
+      }
+      break;
+    case OLED_COLOR_WHITE:
+      for( ; col < end; col++ )
+      {
+        *col |= mask;
+      }
+      break;
+    default:
+      for( ; col < end; col++ )
+      {
+        *col ^= mask;
+      }
+      break;
+  }
+
+  OLED_SH1106_MarkDirty( panel, page, x0, x1 - x0 );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_FillRect
+ *
+ * Details : Fills a rectangle, clipped at the screen edges. Every page
+ *           the rectangle touches is one mask applied along its
+ *           columns, so tall rectangles and vertical lines cost one
+ *           byte operation per 8 rows.
+ *
+ * Argument:
+ *              x, y  -> Top left corner in pixels
+ *              w, h  -> Size in pixels, nothing is drawn if either is <= 0
+ *              color -> OLED_COLOR_*
+ ****************************************************************************/
+void OLED_SH1106_FillRect( struct sh1106_panel *panel, int x, int y, int w, int h, uint8_t color )
+{
+  int x0 = ( x < 0 ) ? 0 : x;
+  int y0 = ( y < 0 ) ? 0 : y;
+  int x1 = ( ( x + w ) > SH1106_MAX_SEG ) ? SH1106_MAX_SEG : ( x + w );
+  int y1 = ( ( y + h ) > OLED_SH1106_HEIGHT ) ? OLED_SH1106_HEIGHT : ( y + h );
+  int page, last;
+  uint8_t mask;
+
+  if( ( w <= 0 ) || ( h <= 0 ) || ( x0 >= x1 ) || ( y0 >= y1 ) )
+  {
+    return;
+  }
+
+  last = ( y1 - 1 ) / 8;
+  for( page = y0 / 8; page <= last; page++ )
+  {
+    mask = 0xFF;
+    if( page == ( y0 / 8 ) )
+    {
+      mask &= (uint8_t)( 0xFF << ( y0 % 8 ) );
+    }
+    if( page == last )
+    {
+      mask &= (uint8_t)( 0xFF >> ( 7 - ( ( y1 - 1 ) % 8 ) ) );
+    }
+    OLED_SH1106_MaskCols( panel, page, x0, x1, mask, color );
+  }
+}
+
+
+void OLED_SH1106_DrawPixel( struct sh1106_panel *panel, int x, int y, uint8_t color )
+{
+  OLED_SH1106_FillRect( panel, x, y, 1, 1, color );
+}
+
+
+void OLED_SH1106_DrawHLine( struct sh1106_panel *panel, int x, int y, int w, uint8_t color )
+{
+  OLED_SH1106_FillRect( panel, x, y, w, 1, color );
+}
+
+
+void OLED_SH1106_DrawVLine( struct sh1106_panel *panel, int x, int y, int h, uint8_t color )
+{
+  OLED_SH1106_FillRect( panel, x, y, 1, h, color );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_DrawRect
+ *
+ * Details : Draws the outline of a rectangle. Every pixel is drawn once,
+ *           so OLED_COLOR_INVERT leaves the corners flipped as well.
+ ****************************************************************************/
+void OLED_SH1106_DrawRect( struct sh1106_panel *panel, int x, int y, int w, int h, uint8_t color )
+{
+  if( ( w <= 0 ) || ( h <= 0 ) )
+  {
+    return;
+  }
+
+  OLED_SH1106_DrawHLine( panel, x, y, w, color );
+  if( h > 1 )
+  {
+    OLED_SH1106_DrawHLine( panel, x, y + h - 1, w, color );
+  }
+  OLED_SH1106_DrawVLine( panel, x, y + 1, h - 2, color );
+  if( w > 1 )
+  {
+    OLED_SH1106_DrawVLine( panel, x + w - 1, y + 1, h - 2, color );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_DrawLine
+ *
+ * Details : Draws a line from x0, y0 to x1, y1, both ends included.
+ *           Bresenham's algorithm walks the pixels, consecutive pixels
+ *           in the same row (flat lines) or column (steep lines) are
+ *           drawn as one run, so horizontal and vertical lines are a
+ *           single rectangle.
+ ****************************************************************************/
+void OLED_SH1106_DrawLine( struct sh1106_panel *panel, int x0, int y0, int x1, int y1, uint8_t color )
+{
+  int dx  = ( x1 > x0 ) ? ( x1 - x0 ) : ( x0 - x1 );
+  int dy  = ( y1 > y0 ) ? ( y0 - y1 ) : ( y1 - y0 );   // negative
+  int sx  = ( x0 < x1 ) ? 1 : -1;
+  int sy  = ( y0 < y1 ) ? 1 : -1;
+  int err = dx + dy;
+  bool flat = ( dx >= -dy );
+  int rx = x0, ry = y0;   // start of the current run
+  int e2, nx, ny;
+
+  for( ;; )
+  {
+    if( ( x0 == x1 ) && ( y0 == y1 ) )
+    {
+      break;
+    }
+
+    nx = x0;
+    ny = y0;
+    e2 = 2 * err;
+    if( e2 >= dy )
+    {
+      err += dy;
+      nx  += sx;
+    }
+    if( e2 <= dx )
+    {
+      err += dx;
+      ny  += sy;
+    }
+
+    if( flat ? ( ny != ry ) : ( nx != rx ) )
+    {
+      // the next pixel leaves the run, draw it up to x0, y0
+      OLED_SH1106_FillRect( panel, ( rx < x0 ) ? rx : x0, ( ry < y0 ) ? ry : y0,
+                            ( ( rx < x0 ) ? ( x0 - rx ) : ( rx - x0 ) ) + 1,
+                            ( ( ry < y0 ) ? ( y0 - ry ) : ( ry - y0 ) ) + 1, color );
+      rx = nx;
+      ry = ny;
+    }
+    x0 = nx;
+    y0 = ny;
+  }
+
+  OLED_SH1106_FillRect( panel, ( rx < x0 ) ? rx : x0, ( ry < y0 ) ? ry : y0,
+                        ( ( rx < x0 ) ? ( x0 - rx ) : ( rx - x0 ) ) + 1,
+                        ( ( ry < y0 ) ? ( y0 - ry ) : ( ry - y0 ) ) + 1, color );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_CirclePoints
+ *
+ * Details : Draws the points cx +- a, cy +- b, each distinct point once.
+ ****************************************************************************/
+static void OLED_SH1106_CirclePoints( struct sh1106_panel *panel, int cx, int cy, int a, int b, uint8_t color )
+{
+  OLED_SH1106_DrawPixel( panel, cx + a, cy + b, color );
+  if( a != 0 )
+  {
+    OLED_SH1106_DrawPixel( panel, cx - a, cy + b, color );
+  }
+  if( b != 0 )
+  {
+    OLED_SH1106_DrawPixel( panel, cx + a, cy - b, color );
+    if( a != 0 )
+    {
+      OLED_SH1106_DrawPixel( panel, cx - a, cy - b, color );
+    }
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_DrawCircle
+ *
+ * Details : Draws a circle outline with the midpoint algorithm. Points
+ *           shared by two octants are drawn once, so the outline also
+ *           works with OLED_COLOR_INVERT.
+ *
+ * Argument:
+ *              cx, cy -> Centre in pixels
+ *              r      -> Radius in pixels, 0 draws the centre only
+ ****************************************************************************/
+void OLED_SH1106_DrawCircle( struct sh1106_panel *panel, int cx, int cy, int r, uint8_t color )
+{
+  int x = 0, y = r;
+  int d = 1 - r;
+
+  if( r < 0 )
+  {
+    return;
+  }
+
+  while( x <= y )
+  {
+    OLED_SH1106_CirclePoints( panel, cx, cy, x, y, color );
+    if( x != y )
+    {
+      OLED_SH1106_CirclePoints( panel, cx, cy, y, x, color );
+    }
+
+    if( d < 0 )
+    {
+      d += 2 * x + 3;
+    }
+    else
+    {
+      d += 2 * ( x - y ) + 5;
+      y--;
+    }
+    x++;
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_FillCircle
+ *
+ * Details : Draws a filled circle as one vertical line per column, which
+ *           suits the page layout: each column costs one byte operation
+ *           per 8 rows. A column at distance dx from the centre reaches
+ *           dy rows up and down, the largest dy with dx^2 + dy^2 <=
+ *           r^2 + r, which matches the outline of OLED_SH1106_DrawCircle().
+ ****************************************************************************/
+void OLED_SH1106_FillCircle( struct sh1106_panel *panel, int cx, int cy, int r, uint8_t color )
+{
+  int dx, dy = r;
+
+  if( r < 0 )
+  {
+    return;
+  }
+
+  for( dx = 0; dx <= r; dx++ )
+  {
+    while( ( dx * dx ) + ( dy * dy ) > ( r * r ) + r )
+    {
+      dy--;
+    }
+    OLED_SH1106_DrawVLine( panel, cx + dx, cy - dy, 2 * dy + 1, color );
+    if( dx != 0 )
+    {
+      OLED_SH1106_DrawVLine( panel, cx - dx, cy - dy, 2 * dy + 1, color );
+    }
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Scroll
+ *
+ * Details : Scrolls the screen contents by a number of pixel rows using
+ *           the display start line. Every column of the framebuffer is
+ *           shifted as one 64 bit word and the start line follows, so
+ *           the rows that stay on the screen keep their place in the
+ *           panel RAM and only the newly exposed (cleared) rows are
+ *           marked dirty: scrolling by one text line costs one page of
+ *           data plus the start line command.
+ *
+ * Argument:
+ *              rows -> Positive scrolls up (new rows at the bottom),
+ *                      negative scrolls down (new rows at the top)
+ * 
+ ****************************************************************************/
+void OLED_SH1106_Scroll( struct sh1106_panel *panel, int rows )
+{
+  unsigned int x, page;
+  uint64_t col;
+
+  if( rows == 0 )
+  {
+    return;
+  }
+
+  if( ( rows >= OLED_SH1106_HEIGHT ) || ( rows <= -OLED_SH1106_HEIGHT ) )
+  {
+    OLED_SH1106_fill( panel, 0x00 );   // everything scrolled out
+    return;
+  }
+
+  for( x = 0; x < SH1106_MAX_SEG; x++ )
+  {
+    col = 0;
+    for( page = 0; page < SH1106_PAGES; page++ )
+    {
+      col |= (uint64_t)panel->fb[page][x] << ( page * 8u );
+    }
+
+    // bit 0 is the top row
+    col = ( rows > 0 ) ? ( col >> rows ) : ( col << -rows );
+
+    for( page = 0; page < SH1106_PAGES; page++ )
+    {
+      panel->fb[page][x] = (uint8_t)( col >> ( page * 8u ) );
+    }
+  }
+
+  panel->start_line = ( panel->start_line + rows ) & ( OLED_SH1106_HEIGHT - 1 );
+
+  if( rows > 0 )
+  {
+    OLED_SH1106_MarkRows( panel, OLED_SH1106_HEIGHT - rows, rows, 0u, SH1106_MAX_SEG );
+  }
+  else
+  {
+    OLED_SH1106_MarkRows( panel, 0u, -rows, 0u, SH1106_MAX_SEG );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ResetScroll
+ *
+ * Details : Moves the start line back to RAM row 0 without changing the
+ *           picture. The whole panel RAM has to be rewritten for that.
+ ****************************************************************************/
+void OLED_SH1106_ResetScroll( struct sh1106_panel *panel )
+{
+  if( panel->start_line != 0u )
+  {
+    panel->start_line = 0u;
+    OLED_SH1106_MarkAllDirty(panel);
+  }
+}
+
+static const uint8_t SH1106_display_on_cmds[] = {
+	0XAD,  //SET DCDC command
+	0X8B,  //DCDC ON
+	0XAF,  //DISPLAY ON
+};
+
+static const uint8_t SH1106_display_off_cmds[] = {
+	0XAD,  //SET DCDC command
+	0X8A,  //DCDC OFF
+	0XAE,  //DISPLAY OFF
+};
+
+
+void OLED_Display_On(struct sh1106_panel *panel)
+{
+	OLED_SH1106_WriteCmds(panel, SH1106_display_on_cmds, sizeof(SH1106_display_on_cmds));
+}
+
+
+void OLED_Display_Off(struct sh1106_panel *panel)
+{
+	OLED_SH1106_WriteCmds(panel, SH1106_display_off_cmds, sizeof(SH1106_display_off_cmds));
+}
+
+
+/*
+** Init sequence, sent as one command transfer. Every register is set
+** once; the values are the ones of the usual 128 x 64 modules.
+*/
+static const uint8_t SH1106_init_cmds[] = {
+  0xAE,         // Display OFF
+  0xD5, 0x80,   // Display clock divide ratio and oscillator frequency
+  0xA8, 0x3F,   // Multiplex ratio, 64 COM lines
+  0xD3, 0x00,   // Display offset 0
+  0x40,         // Display start line 0
+  0x8D, 0x14,   // Charge pump on, for SSD1306 compatible modules, the SH1106 ignores it
+  0xAD, 0x8B,   // DC-DC on, a warm init may find it switched off by OLED_SH1106_Sleep()
+  0xA1,         // Segment remap, column 131 mapped to SEG0
+  0xC8,         // COM scan direction, COM63 to COM0
+  0xDA, 0x12,   // COM pins hardware configuration, alternative
+  0x81, SH1106_CONTRAST,   // Contrast
+  0xD9, 0xF1,   // Pre-charge period, phase 1 15 DCLK, phase 2 1 DCLK
+  0xDB, 0x40,   // VCOMH deselect level
+  0xA4,         // Display follows RAM content
+  0xA6,         // Normal, not inverted display
+  0xAF,         // Display ON, has to stay the last entry
+};
+
+/****************************************************************************
+ * Name: OLED_SH1106_DisplayInit
+ *
+ * Details : Brings the panel up: pulses the reset line with the timing
+ *           from reset_assert_us and reset_deassert_us, sends the init
+ *           table in one burst and clears the screen. The reset is
+ *           skipped when the controller is known to be configured,
+ *           either because it already runs (panel->ready) or because
+ *           the transport found it configured (panel->warm). The table
+ *           sets every register anyway but leaves the display RAM
+ *           alone, so such a warm init keeps the picture on the screen
+ *           and sends no frame. The panel counts as ready only once
+ *           the table went out.
+ *
+ * Return  : 0 or the transfer error
+ ****************************************************************************/
+int OLED_SH1106_DisplayInit(struct sh1106_panel *panel)
+{
+  bool cold;
+  int ret;
+  
+  OLED_SH1106_BusLock( panel );
+  cold = ( panel->ready == false ) && ( panel->warm == false );
+  if( cold )
+  {
+    //Pulse the RESET line
+    panel->ops->set_reset( panel, 1 );
+    panel->ops->delay_us( panel, panel->reset_assert_us );
+    panel->ops->set_reset( panel, 0 );
+    panel->ops->delay_us( panel, panel->reset_deassert_us );
+  }
+  panel->warm = false;
+  panel->asleep = false;
+  panel->dc_state = -1;
+  panel->hw_start_line = 0u;   // the init table sets start line 0
+  panel->contrast = SH1106_CONTRAST;
+  panel->inverted = false;
+  panel->ready = true;         // lets the table through, withdrawn if it fails
+
+  memcpy( panel->cmd_buf, SH1106_init_cmds, sizeof(SH1106_init_cmds) );
+  ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, sizeof(SH1106_init_cmds) );
+  panel->ready = ( ret >= 0 );
+  OLED_SH1106_BusUnlock( panel );
+  
+  if( ret < 0 )
+  {
+    return( ret );
+  }
+
+  // The RAM of a reset controller holds noise
+  if( cold )
+  {
+    OLED_Clear(panel, 0x00);
+  }
+    
+  return( 0 );
+}
+
+
+void OLED_SH1106_DisplayDeInit(struct sh1106_panel *panel)
+{
+  OLED_SH1106_BusLock( panel );   // waits for a running flush
+  if( panel->ready )
+  {
+    panel->ready = false;
+    panel->ops->set_reset( panel, 1 );  //Hold the panel in reset
+  }
+  OLED_SH1106_BusUnlock( panel );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Sleep
+ *
+ * Details : Turns the display and the DC-DC converter off. The display
+ *           RAM keeps its contents, so OLED_SH1106_Wake() only has to
+ *           switch them on again. Nothing happens before the panel was
+ *           initialised.
+ *
+ * Return  : 0 or the transfer error
+ ****************************************************************************/
+int OLED_SH1106_Sleep( struct sh1106_panel *panel )
+{
+  int ret = 0;
+
+  OLED_SH1106_BusLock( panel );
+  if( ( panel->ready ) && ( panel->asleep == false ) )
+  {
+    memcpy( panel->cmd_buf, SH1106_display_off_cmds, sizeof(SH1106_display_off_cmds) );
+    ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, sizeof(SH1106_display_off_cmds) );
+    if( ret >= 0 )
+    {
+      panel->asleep = true;
+    }
+  }
+  OLED_SH1106_BusUnlock( panel );
+
+  return( ret < 0 ? ret : 0 );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Wake
+ *
+ * Details : Turns a sleeping panel on again. With restore the panel may
+ *           have lost power: it is reset and configured with the init
+ *           table and the contrast and inversion last set, then shown,
+ *           which holds exactly what the panel RAM held, goes out as one
+ *           full frame with hw_start_line. All of them belong to the bus
+ *           lock, so frames composed meanwhile under the framebuffer
+ *           lock cannot tear or rotate the restore. The display is
+ *           switched on last, so the old picture appears at once and
+ *           nothing half-drawn is ever shown.
+ *
+ * Argument:
+ *              restore -> true if the display RAM has to be rewritten
+ *
+ * Return  : 0 or the first transfer error
+ ****************************************************************************/
+int OLED_SH1106_Wake( struct sh1106_panel *panel, bool restore )
+{
+  struct sh1106_frame frame;
+  size_t bytes, len;
+  int ret = 0;
+
+  OLED_SH1106_BusLock( panel );
+  if( ( panel->ready == false ) || ( panel->asleep == false ) )
+  {
+    OLED_SH1106_BusUnlock( panel );
+    return( 0 );
+  }
+
+  if( restore )
+  {
+    panel->ops->set_reset( panel, 1 );
+    panel->ops->delay_us( panel, panel->reset_assert_us );
+    panel->ops->set_reset( panel, 0 );
+    panel->ops->delay_us( panel, panel->reset_deassert_us );
+    panel->dc_state = -1;
+
+    // everything but the final display on, then the contrast and inversion set since
+    len = sizeof(SH1106_init_cmds) - 1;
+    memcpy( panel->cmd_buf, SH1106_init_cmds, len );
+    panel->cmd_buf[len++] = 0x81;
+    panel->cmd_buf[len++] = panel->contrast;
+    panel->cmd_buf[len++] = panel->inverted ? 0xA7 : 0xA6;
+    ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, len );
+
+    frame.data = panel->shown;
+    frame.start_line = panel->hw_start_line;
+    frame.bridged = 0;
+    memset( frame.cols, 0xFF, sizeof(frame.cols) );
+    panel->hw_start_line = 0u;   // set by the init table
+    if( ret >= 0 )
+    {
+      ret = OLED_SH1106_Send( panel, &frame, &bytes );
+    }
+  }
+
+  if( ret >= 0 )
+  {
+    memcpy( panel->cmd_buf, SH1106_display_on_cmds, sizeof(SH1106_display_on_cmds) );
+    ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, sizeof(SH1106_display_on_cmds) );
+  }
+  if( ret >= 0 )
+  {
+    panel->asleep = false;
+  }
+  OLED_SH1106_BusUnlock( panel );
+
+  return( ret < 0 ? ret : 0 );
+}
+
+
+
+
+void OLED_Clear(struct sh1106_panel *panel, uint8_t dat)  
+{  
+  OLED_SH1106_fill( panel, dat );
+  OLED_SH1106_Flush(panel);
+}
+
+/****************************************************************************
+ * Name: OLED_Display
+ *
+ * Details : Resends the whole framebuffer, e.g. after the panel RAM was
+ *           lost.
+ ****************************************************************************/
+void OLED_Display(struct sh1106_panel *panel)
+{
+  OLED_SH1106_MarkAllDirty(panel);
+  OLED_SH1106_Flush(panel);
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Flush
+ *
+ * Details : Hands the frame to the transport's flush hook. The kernel
+ *           driver takes the dirty spans at once with
+ *           OLED_SH1106_Snapshot(), queues the frame for its flush
+ *           worker and returns immediately; what happens when the queue
+ *           is full depends on the queue policy (OLED_QUEUE_*). Nothing
+ *           happens when the framebuffer is clean.
+ ****************************************************************************/
+void OLED_SH1106_Flush(struct sh1106_panel *panel)
+{
+  uint8_t page;
+
+  for( page = 0; page < SH1106_PAGES; page++ )
+  {
+    if( OLED_SH1106_PageDirty( panel->dirty[page] ) )
+    {
+      panel->ops->flush( panel );
+      break;
+    }
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_ComposePage
+ *
+ * Details : Builds columns lo - hi of a RAM page in the front buffer from
+ *           the screen ordered back buffer. With a start line that is a
+ *           multiple of 8 this is a plain copy of one screen page,
+ *           otherwise every byte is put together from two neighbouring
+ *           screen pages.
+ ****************************************************************************/
+static void OLED_SH1106_ComposePage( struct sh1106_panel *panel, uint8_t page, uint8_t start_line,
+                                     uint8_t lo, uint8_t hi )
+{
+  // first screen row held by this RAM page
+  uint8_t row   = ( ( page * 8u ) - start_line ) & ( OLED_SH1106_HEIGHT - 1 );
+  uint8_t p0    = row / 8;
+  uint8_t p1    = ( p0 + 1 ) & SH1106_MAX_LINE;
+  uint8_t shift = row % 8;
+  unsigned int x;
+
+  if( shift == 0u )
+  {
+    memcpy( &panel->front[page][lo], &panel->fb[p0][lo], hi - lo + 1 );
+    return;
+  }
+
+  for( x = lo; x <= hi; x++ )
+  {
+    panel->front[page][x] = ( panel->fb[p0][x] >> shift ) | ( panel->fb[p1][x] << ( 8u - shift ) );
+  }
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_AddrCost
+ *
+ * Details : Number of column address bytes needed to move the panel's
+ *           column pointer from cur to col. The high and low nibble are
+ *           separate commands, so only the ones that differ are sent.
+ *
+ * Argument:
+ *              cur -> Current RAM column, -1 if unknown
+ *              col -> RAM column to go to
+ ****************************************************************************/
+static unsigned int OLED_SH1106_AddrCost( int cur, unsigned int col )
+{
+  if( cur < 0 )
+  {
+    return( 2u );
+  }
+
+  return( ( ( (unsigned int)cur >> 4 ) != ( col >> 4 ) ) + ( ( (unsigned int)cur & 0x0Fu ) != ( col & 0x0Fu ) ) );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_PlanPage
+ *
+ * Details : Decides for every gap between two dirty runs of a page
+ *           whether to jump over it or to resend the unchanged columns.
+ *           Jumping costs the column address bytes plus a command and
+ *           a data transfer, resending costs the gap. The choices are
+ *           independent of each other, so taking the cheaper one for
+ *           every gap gives the shortest stream for the page. Bridged
+ *           gaps are set in map.
+ *
+ * Return  : Number of bridged columns
+ ****************************************************************************/
+static unsigned int OLED_SH1106_PlanPage( struct sh1106_panel *panel, uint32_t *map )
+{
+  unsigned int bridged = 0;
+  uint8_t lo, hi, next_lo, next_hi;
+
+  if( OLED_SH1106_NextRun( map, 0, &lo, &hi ) == false )
+  {
+    return( 0 );
+  }
+
+  while( OLED_SH1106_NextRun( map, hi + 1u, &next_lo, &next_hi ) )
+  {
+    unsigned int gap  = next_lo - hi - 1u;
+    unsigned int jump = OLED_SH1106_AddrCost( hi + 1 + XLevelL, next_lo + XLevelL ) + 2u * panel->xfer_cost;
+
+    if( gap <= jump )
+    {
+      OLED_SH1106_SetCols( map, hi + 1u, next_lo - 1u );
+      bridged += gap;
+    }
+    hi = next_hi;
+  }
+
+  return( bridged );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Snapshot
+ *
+ * Details : First half of a flush, called with the framebuffer lock
+ *           held. Plans the transfers of every dirty RAM page, composes
+ *           the planned columns from the back buffer into the front
+ *           buffer, marks the back buffer clean and records what has to
+ *           be sent in frame. Bridged columns did not change, composing
+ *           them again gives what the panel already holds.
+ *
+ * Return  : Number of dirty pages
+ ****************************************************************************/
+unsigned int OLED_SH1106_Snapshot( struct sh1106_panel *panel, struct sh1106_frame *frame )
+{
+  unsigned int pages = 0;
+  unsigned int from;
+  uint8_t page, lo, hi;
+
+  frame->data = panel->front;
+  frame->start_line = panel->start_line;
+  frame->bridged = 0;
+  memcpy( frame->cols, panel->dirty, sizeof(frame->cols) );
+  memset( panel->dirty, 0, sizeof(panel->dirty) );
+
+  for( page = 0; page < SH1106_PAGES; page++ )
+  {
+    if( OLED_SH1106_PageDirty( frame->cols[page] ) == false )
+    {
+      continue;
+    }
+
+    frame->bridged += OLED_SH1106_PlanPage( panel, frame->cols[page] );
+    for( from = 0; ( from < SH1106_MAX_SEG ) && OLED_SH1106_NextRun( frame->cols[page], from, &lo, &hi ); from = hi + 1u )
+    {
+      OLED_SH1106_ComposePage( panel, page, frame->start_line, lo, hi );
+    }
+    pages++;
+  }
+
+  return( pages );
+}
+
+/****************************************************************************
+ * Name: OLED_SH1106_Send
+ *
+ * Details : Second half of a flush, called with the bus lock held but
+ *           not the framebuffer lock. Sends the runs planned by
+ *           OLED_SH1106_Snapshot() from frame->data, each as one
+ *           data transfer. The panel keeps its page and column pointers
+ *           between runs and the column advances with every data byte,
+ *           so only the address commands that change the pointers are
+ *           sent. Pages without runs are not addressed at all. A
+ *           changed start line goes out after the data.
+ *
+ * Argument:
+ *              frame -> Plan from OLED_SH1106_Snapshot()
+ *              bytes -> Returns the number of bytes sent
+ *
+ * Return  : 0 or the first transfer error
+ ****************************************************************************/
+int OLED_SH1106_Send( struct sh1106_panel *panel, const struct sh1106_frame *frame, size_t *bytes )
+{
+  int cur_page = -1;
+  int cur_col  = -1;   // RAM column the next data byte goes to
+  uint8_t page, lo, hi;
+  int ret = 0;
+
+  *bytes = 0;
+  for( page = 0; ( page < SH1106_PAGES ) && ( ret >= 0 ); page++ )
+  {
+    unsigned int from = 0;
+
+    while( ( ret >= 0 ) && ( from < SH1106_MAX_SEG ) && OLED_SH1106_NextRun( frame->cols[page], from, &lo, &hi ) )
+    {
+      uint8_t col = lo + XLevelL;   // visible area starts at column 2 of the SH1106 RAM
+      size_t n = 0;
+
+      if( cur_page != page )
+      {
+        panel->cmd_buf[n++] = YLevel + page;                    //Set page address(0~7)
+      }
+      if( ( cur_col < 0 ) || ( ( cur_col >> 4 ) != ( col >> 4 ) ) )
+      {
+        panel->cmd_buf[n++] = XLevelH | ( col >> 4 );           //Set column high address
+      }
+      if( ( cur_col < 0 ) || ( ( cur_col & 0x0F ) != ( col & 0x0F ) ) )
+      {
+        panel->cmd_buf[n++] = col & 0x0F;                       //Set column low address
+      }
+
+      if( n > 0u )
+      {
+        ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, n );
+      }
+      if( ret >= 0 )
+      {
+        ret = OLED_SH1106_WriteBuf( panel, false, &frame->data[page][lo], hi - lo + 1 );
+      }
+      if( ( ret >= 0 ) && ( frame->data != (const uint8_t (*)[SH1106_MAX_SEG])panel->shown ) )
+      {
+        memcpy( &panel->shown[page][lo], &frame->data[page][lo], hi - lo + 1 );
+      }
+      *bytes += n + hi - lo + 1;
+
+      cur_page = page;
+      cur_col  = hi + 1 + XLevelL;
+      from     = hi + 1u;
+    }
+  }
+  if( ret >= 0 )
+  {
+    panel->stats.bridged += frame->bridged;
+  }
+
+  if( ( ret >= 0 ) && ( panel->ready ) && ( frame->start_line != panel->hw_start_line ) )
+  {
+    panel->cmd_buf[0] = 0x40 | frame->start_line;   //Set display start line
+    ret = OLED_SH1106_WriteBuf( panel, true, panel->cmd_buf, 1 );
+    if( ret >= 0 )
+    {
+      panel->hw_start_line = frame->start_line;
+    }
+    *bytes += 1;
+  }
+
+  return( ret );
+}
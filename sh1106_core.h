@@ -0,0 +1,247 @@
+/*
+** Transport independent core of the SH1106 OLED driver, see sh1106_core.c.
+** Shared by the kernel module and the userspace emulator in sim/.
+*/
+#ifndef SH1106_CORE_H
+#define SH1106_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/cache.h>
+#include <linux/types.h>
+#define SH1106_DMA_ALIGNED     ____cacheline_aligned
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#define SH1106_DMA_ALIGNED
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a)          ( sizeof(a) / sizeof((a)[0]) )
+#endif
+#endif
+
+#include "sh1106_ioctl.h"
+
+#define SH1106_MAX_SEG         ( 128 )   // Maximum segment
+#define SH1106_MAX_LINE        (   7 )   // Maximum line
+#define SH1106_PAGES           ( SH1106_MAX_LINE + 1 )   // Number of pages
+#define SH1106_DEF_FONT_SIZE   (   5 )   // Default font size
+#define SH1106_GLYPH_WIDTH     ( SH1106_DEF_FONT_SIZE + 1 )   // Glyph plus spacer column
+#define SH1106_FIRST_CHAR      ( 0x20 )  // First character in SH1106_font
+#define SH1106_LAST_CHAR       ( 0x7E )  // Last character in SH1106_font
+#define SH1106_CMD_BUF_SIZE    (  32 )   // Largest command run sent at once, holds the init table of a wake
+#define SH1106_CON_COLS        ( SH1106_MAX_SEG / SH1106_GLYPH_WIDTH )   // Console characters per line
+#define SH1106_CON_LINES       (  64 )   // Console lines kept, screen plus scrollback
+#define SH1106_CON_TAB         (   4 )   // Console tab stop distance
+#define OLED_LAT_BUCKETS       (  20 )   // Flush latency histogram, 1 us to 0.5 s and above
+#define SH1106_DIRTY_WORDS     ( SH1106_MAX_SEG / 32 )   // Words of a column bitmap
+#define SH1106_XFER_COST       (   8 )   // Default cost of a bus transfer in bytes
+#define SH1106_RESET_US        (  10 )   // Reset pulse width, datasheet minimum
+#define SH1106_RESET_WAIT_US   (  10 )   // Wait after the reset pulse, reset time plus margin
+#define SH1106_CONTRAST        ( 0xCF )  // Contrast set by the init table
+#define SH1106_I2C_CO          ( 0x80 )  // I2C control byte: only the next byte is covered
+#define SH1106_I2C_DATA        ( 0x40 )  // I2C control byte: display data follows, commands if clear
+#define SH1106_I2C_MAX_DATA    ( SH1106_MAX_SEG )   // Payload of one I2C message, a page of data
+#define SH1106_FONT_CHARS      ( SH1106_LAST_CHAR - SH1106_FIRST_CHAR + 1 )   // Characters of the built-in font
+
+
+/*
+** Bus and flush counters. The core counts the transfers, the transport
+** counts flush requests and flush results (the kernel driver shows them
+** in <debugfs>/oled_sh1106N/stats).
+*/
+struct sh1106_stats
+{
+    uint64_t transfers;                       // bus transfers
+    uint64_t cmd_bytes;                       // command bytes sent
+    uint64_t data_bytes;                      // display data bytes sent
+    uint64_t dc_toggles;                      // DC line changes
+    uint64_t errors;                          // failed transfers
+    uint64_t requests;                        // OLED_SH1106_Flush() calls that started a flush
+    uint64_t coalesced;                       // calls merged into an already queued flush
+    uint64_t queue_dropped;                   // queued frames dropped to make room for a newer one
+    uint64_t flushes;                         // flushes that sent a frame
+    uint64_t dropped;                         // frames lost: panel not ready or a transfer failed
+    uint64_t bridged;                         // unchanged bytes sent instead of re-addressing
+    uint64_t lat_total_us;                    // sum of the flush latencies
+    uint64_t lat_max_us;
+    uint64_t lat_hist[OLED_LAT_BUCKETS];      // bucket n: latency in [2^(n-1), 2^n) us, bucket 0: < 1 us
+};
+
+
+struct sh1106_panel;
+
+/*
+** Font in page format. Character c from first to last is width[c - first]
+** columns wide; its glyph starts at bits + offset[c - first] and holds
+** pages rows of width bytes laid out like the framebuffer, so drawing it
+** is one copy per page. Characters of width 0 are missing.
+*/
+struct sh1106_font
+{
+    uint8_t first;
+    uint8_t last;
+    uint8_t pages;                            // glyph height in pages
+    uint8_t spacing;                          // blank columns after each glyph
+    const uint8_t *width;
+    const uint8_t *bits;
+    uint16_t offset[256];
+};
+
+/*
+** Transport of a panel. write() sends one run of bytes with the DC level
+** last set by set_dc(); the buffer is DMA-safe. flush() is called by
+** OLED_SH1106_Flush() when the framebuffer has dirty pages and has to get
+** them to the panel through OLED_SH1106_Snapshot() and OLED_SH1106_Send(),
+** either right away or later from another context. lock() and unlock()
+** guard the bus and may be NULL when there is no concurrency.
+**
+** Buses without a DC line (I2C) leave set_dc() NULL, their write() finds
+** the level in panel->dc_state and sends it in a control byte.
+*/
+struct sh1106_bus_ops
+{
+    int  (*write)( struct sh1106_panel *panel, const uint8_t *buf, size_t len );
+    void (*set_dc)( struct sh1106_panel *panel, int value );       // 0 = command, 1 = data
+    void (*set_reset)( struct sh1106_panel *panel, int value );    // 1 holds the panel in reset
+    void (*delay_us)( struct sh1106_panel *panel, unsigned int us );
+    void (*flush)( struct sh1106_panel *panel );
+    void (*lock)( struct sh1106_panel *panel );
+    void (*unlock)( struct sh1106_panel *panel );
+};
+
+/*
+** What one flush sends, planned by OLED_SH1106_Snapshot(): a bitmap of
+** the columns of every RAM page, where every run of set bits goes out
+** as one data transfer, and the start line. The runs are sent from data,
+** which is the front buffer unless the transport queues a copy of it.
+*/
+struct sh1106_frame
+{
+    uint32_t cols[SH1106_PAGES][SH1106_DIRTY_WORDS];
+    const uint8_t (*data)[SH1106_MAX_SEG];    // RAM pages the runs are taken from, DMA-safe
+    unsigned int bridged;                     // columns sent only to join two runs
+    uint8_t start_line;
+};
+
+/*
+** Panel state. All drawing functions render into the shadow (back)
+** framebuffer and record which columns of each page changed.
+** OLED_SH1106_Flush() hands the frame to the transport, which copies the
+** dirty spans into the front buffer and sends them from there, so
+** drawing may go on in fb while the previous frame is still going out.
+** A page is clean when its dirty bitmap is all zero.
+**
+** Each run of changed columns costs a transfer plus the address bytes
+** to get there, so the flush bridges gaps that are cheaper to resend
+** than to skip. xfer_cost is the price of one transfer in bytes: small
+** values favour re-addressing, large ones favour longer transfers.
+**
+** The panel RAM is used as a ring: start_line is the RAM row shown at
+** the top of the screen, so screen row r lives in RAM row
+** (r + start_line) % 64. fb and front stay in screen order, the dirty
+** spans are kept in RAM pages and the flush rotates the rows on the way
+** out. Scrolling moves fb and start_line together, after which only the
+** newly exposed rows differ from what the panel already holds.
+**
+** write() feeds a text console: con_text is a ring of SH1106_CON_LINES
+** lines, the screen shows the 8 lines from con_top on (or older ones
+** while con_view > 0). Lines that changed and lines that scrolled are
+** collected in con_dirty and con_scroll and rendered once per write().
+**
+** shown mirrors the display RAM as OLED_SH1106_Send() left it. It is
+** only touched under the bus lock, so a wake after power loss can
+** restore the panel from it together with hw_start_line while new
+** frames are being composed into front.
+**
+** The transport allocates fb, front, shown and con_text. front, shown
+** and cmd_buf are handed to the bus directly and therefore have to stay
+** DMA-safe.
+** Drawing functions expect the caller to serialise them (the kernel
+** driver's framebuffer lock), the command functions take the bus lock
+** through the ops themselves.
+*/
+struct sh1106_panel
+{
+    const struct sh1106_bus_ops *ops;
+    uint8_t line_num;                         // text cursor line
+    uint8_t cursor_pos;                       // text cursor column
+    uint8_t font;                             // font slot of the text calls
+    const struct sh1106_font *fonts[OLED_FONT_SLOTS];   // NULL if empty, the built-in ones are set by InitPanel
+    char    (*con_text)[SH1106_CON_COLS];     // console lines, ring of SH1106_CON_LINES
+    uint8_t con_top;                          // con_text line shown at the top of the screen
+    uint8_t con_row;                          // console cursor line on the screen
+    uint8_t con_col;                          // console cursor column in characters
+    uint8_t con_used;                         // scrollback lines above con_top
+    uint8_t con_view;                         // scrollback lines shown above the live screen
+    uint8_t con_dirty;                        // screen lines to render, bit per line
+    unsigned int con_scroll;                  // lines scrolled since the last render
+    uint32_t dirty[SH1106_PAGES][SH1106_DIRTY_WORDS];   // changed columns per RAM page, bit per column
+    unsigned int xfer_cost;                   // cost of a bus transfer in bytes, for the flush planner
+    uint8_t start_line;                       // RAM row shown at the top of the screen
+    uint8_t hw_start_line;                    // start line last sent, protected by the bus lock
+    bool    ready;                            // panel initialised, may be written
+    bool    warm;                             // controller still configured, the next init skips the reset
+    bool    asleep;                           // display and DC-DC off, RAM kept, protected by the bus lock
+    bool    inverted;                         // inversion last sent, protected by the bus lock
+    uint8_t contrast;                         // contrast last sent, protected by the bus lock
+    unsigned int reset_assert_us;             // reset pulse width
+    unsigned int reset_deassert_us;           // wait after the reset pulse
+    int     dc_state;                         // last DC level driven, -1 if unknown
+    uint8_t (*fb)[SH1106_MAX_SEG];            // back buffer, page format
+    uint8_t (*front)[SH1106_MAX_SEG];         // front buffer, in RAM page order
+    uint8_t (*shown)[SH1106_MAX_SEG];         // display RAM as sent, protected by the bus lock
+    struct sh1106_stats stats;
+    uint8_t cmd_buf[SH1106_CMD_BUF_SIZE] SH1106_DMA_ALIGNED;        // bounce buffer for commands
+};
+
+
+void OLED_SH1106_BuildGlyphCache( void );
+void OLED_SH1106_InitPanel( struct sh1106_panel *panel, const struct sh1106_bus_ops *ops );
+int  OLED_SH1106_DisplayInit( struct sh1106_panel *panel );
+void OLED_SH1106_DisplayDeInit( struct sh1106_panel *panel );
+int  OLED_SH1106_Sleep( struct sh1106_panel *panel );
+int  OLED_SH1106_Wake( struct sh1106_panel *panel, bool restore );
+int  OLED_SH1106_WriteCmds( struct sh1106_panel *panel, const uint8_t *cmds, size_t len );
+void OLED_SH1106_SetCursor( struct sh1106_panel *panel, uint8_t lineNo, uint8_t cursorPos );
+void OLED_SH1106_GoToNextLine( struct sh1106_panel *panel );
+void OLED_SH1106_PrintChar( struct sh1106_panel *panel, unsigned char c );
+void OLED_SH1106_String( struct sh1106_panel *panel, char *str );
+void OLED_SH1106_Text( struct sh1106_panel *panel, const char *str, size_t len );
+int  OLED_SH1106_SetFont( struct sh1106_panel *panel, unsigned int slot );
+int  OLED_SH1106_FontParse( struct sh1106_font *font, const uint8_t *data, size_t len );
+void OLED_SH1106_InvertDisplay( struct sh1106_panel *panel, bool need_to_invert );
+void OLED_SH1106_SetBrightness( struct sh1106_panel *panel, uint8_t brightnessValue );
+void OLED_SH1106_fill( struct sh1106_panel *panel, uint8_t data );
+void OLED_SH1106_PrintLogo( struct sh1106_panel *panel );
+void OLED_SH1106_ClearDisplay( struct sh1106_panel *panel );
+void OLED_SH1106_MarkRect( struct sh1106_panel *panel, uint8_t x, uint8_t y, uint8_t width, uint8_t height );
+void OLED_SH1106_Blit( struct sh1106_panel *panel, int x, int y, int w, int h, const uint8_t *src );
+int  OLED_SH1106_UploadCheck( const uint8_t *data, size_t len, uint8_t format );
+int  OLED_SH1106_Upload( struct sh1106_panel *panel, const uint8_t *data, size_t len, uint8_t format );
+void OLED_SH1106_BlitRop( struct sh1106_panel *panel, int x, int y, int w, int h, const uint8_t *src, uint8_t rop );
+void OLED_SH1106_Image( struct sh1106_panel *panel, int x, int y, int w, int h,
+                        const uint8_t *src, size_t stride, uint8_t rop );
+void OLED_SH1106_Pixels( struct sh1106_panel *panel, int x, int y, int w, int h, const uint8_t *src,
+                         size_t stride, uint8_t format, uint8_t dither, uint8_t level );
+void OLED_SH1106_DrawPixel( struct sh1106_panel *panel, int x, int y, uint8_t color );
+void OLED_SH1106_DrawHLine( struct sh1106_panel *panel, int x, int y, int w, uint8_t color );
+void OLED_SH1106_DrawVLine( struct sh1106_panel *panel, int x, int y, int h, uint8_t color );
+void OLED_SH1106_DrawLine( struct sh1106_panel *panel, int x0, int y0, int x1, int y1, uint8_t color );
+void OLED_SH1106_DrawRect( struct sh1106_panel *panel, int x, int y, int w, int h, uint8_t color );
+void OLED_SH1106_FillRect( struct sh1106_panel *panel, int x, int y, int w, int h, uint8_t color );
+void OLED_SH1106_DrawCircle( struct sh1106_panel *panel, int cx, int cy, int r, uint8_t color );
+void OLED_SH1106_FillCircle( struct sh1106_panel *panel, int cx, int cy, int r, uint8_t color );
+void OLED_SH1106_Scroll( struct sh1106_panel *panel, int rows );
+void OLED_SH1106_ResetScroll( struct sh1106_panel *panel );
+void OLED_SH1106_ConsoleWrite( struct sh1106_panel *panel, const char *buf, size_t len );
+void OLED_SH1106_ConsoleRender( struct sh1106_panel *panel );
+void OLED_SH1106_ConsoleView( struct sh1106_panel *panel, int lines );
+void OLED_Display( struct sh1106_panel *panel );
+void OLED_Display_On( struct sh1106_panel *panel );
+void OLED_Display_Off( struct sh1106_panel *panel );
+void OLED_Clear( struct sh1106_panel *panel, uint8_t dat );
+void OLED_SH1106_Flush( struct sh1106_panel *panel );
+unsigned int OLED_SH1106_Snapshot( struct sh1106_panel *panel, struct sh1106_frame *frame );
+int  OLED_SH1106_Send( struct sh1106_panel *panel, const struct sh1106_frame *frame, size_t *bytes );
+
+#endif /* SH1106_CORE_H */
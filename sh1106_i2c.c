@@ -0,0 +1,133 @@
+/*
+** I2C backend of the SH1106 OLED driver, see sh1106_bus.h.
+**
+** The I2C variants of the panel have no DC line. Every write starts
+** with a control byte whose D/C# bit says whether commands or display
+** data follow; with Co = 0 it covers the rest of the message. So a run
+** of commands or a page of data goes out as one i2c_transfer() message
+** instead of a transaction per byte.
+**
+** Adapters that only speak SMBus, like i2c-stub, get the same bytes on
+** the wire through I2C block writes, with the control byte as the
+** command code, in chunks of I2C_SMBUS_BLOCK_MAX bytes. For a test:
+**   modprobe i2c-stub chip_addr=0x3c
+**   echo sh1106 0x3c > /sys/bus/i2c/devices/i2c-N/new_device
+*/
+#include <linux/i2c.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "sh1106_core.h"
+#include "sh1106_bus.h"
+
+struct oled_i2c
+{
+    struct i2c_client *client;
+    bool smbus;                               // adapter without plain I2C messages
+    u8 msg[1 + SH1106_I2C_MAX_DATA];          // control byte and payload, used under the bus lock
+};
+
+/*
+** Send a run of commands or data. The core never sends more than a page
+** of data or SH1106_CMD_BUF_SIZE command bytes at once, so on I2C every
+** run is a single message and commands are never split.
+*/
+static int oled_i2c_write(void *ctx, const u8 *buf, size_t len, bool data)
+{
+    struct oled_i2c *i2c = ctx;
+    u8 ctrl = data ? SH1106_I2C_DATA : 0x00;
+    size_t n;
+    int ret;
+
+    while (len)
+    {
+        if (i2c->smbus)
+        {
+            n = min_t(size_t, len, I2C_SMBUS_BLOCK_MAX);
+            ret = i2c_smbus_write_i2c_block_data(i2c->client, ctrl, n, buf);
+        }
+        else
+        {
+            n = min_t(size_t, len, SH1106_I2C_MAX_DATA);
+            i2c->msg[0] = ctrl;
+            memcpy(i2c->msg + 1, buf, n);
+            ret = i2c_master_send(i2c->client, i2c->msg, n + 1);
+            if (ret >= 0 && (size_t)ret != n + 1)
+                ret = -EIO;
+        }
+        if (ret < 0)
+            return ret;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static const struct oled_bus oled_i2c_bus = {
+    .name = "I2C",
+    .dc_gpio = false,
+    .write = oled_i2c_write,
+};
+
+// Probe function
+static int oled_i2c_probe(struct i2c_client *client)
+{
+    struct oled_i2c *i2c;
+
+    i2c = devm_kzalloc(&client->dev, sizeof(*i2c), GFP_KERNEL);
+    if (!i2c)
+        return -ENOMEM;
+    i2c->client = client;
+
+    i2c->smbus = !i2c_check_functionality(client->adapter, I2C_FUNC_I2C);
+    if (i2c->smbus && !i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_I2C_BLOCK))
+    {
+        dev_err(&client->dev, "Adapter can send neither I2C messages nor I2C block writes\n");
+        return -EOPNOTSUPP;
+    }
+
+    return oled_probe_bus(&client->dev, &oled_i2c_bus, i2c);
+}
+
+// Remove function
+static void oled_i2c_remove(struct i2c_client *client)
+{
+    oled_remove_bus(&client->dev);
+}
+
+static const struct i2c_device_id oled_i2c_ids[] = {
+    {"sh1106", 0},
+    {},
+};
+MODULE_DEVICE_TABLE(i2c, oled_i2c_ids);
+
+// Device tree compatible strings
+static const struct of_device_id oled_i2c_dt_ids[] = {
+    {.compatible = "sh1106"},
+    {},
+};
+MODULE_DEVICE_TABLE(of, oled_i2c_dt_ids);
+
+// I2C driver structure
+static struct i2c_driver oled_i2c_driver = {
+    .driver = {
+        .name = "oled_i2c_driver",
+        .of_match_table = of_match_ptr(oled_i2c_dt_ids),
+        .pm = pm_ptr(&oled_pm_ops),
+    },
+    .probe_new = oled_i2c_probe,
+    .remove = oled_i2c_remove,
+    .id_table = oled_i2c_ids,
+};
+
+int oled_i2c_register(void)
+{
+    return i2c_add_driver(&oled_i2c_driver);
+}
+
+void oled_i2c_unregister(void)
+{
+    i2c_del_driver(&oled_i2c_driver);
+}
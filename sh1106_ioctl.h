@@ -0,0 +1,377 @@
+/*
+** Userspace interface of the SH1106 OLED driver (/dev/oled_sh1106N).
+**
+** Besides the ioctls below, text written to the device with write() goes
+** to a console of 8 lines by 21 characters that scrolls and keeps a
+** scrollback, e.g. `tail -f log > /dev/oled_sh11060`. It understands
+** '\n', '\r', '\b', '\t' and '\f' (clear screen).
+**
+** Shared by driver_spi_sh1106.c and the userspace programs so that the
+** ioctl numbers and structure layouts cannot drift apart.
+*/
+#ifndef SH1106_IOCTL_H
+#define SH1106_IOCTL_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+#endif
+
+#define OLED_SH1106_WIDTH                128
+#define OLED_SH1106_HEIGHT               64
+/*
+** mmap() of the device gives access to the framebuffer: 8 pages of 128
+** bytes, byte [page * 128 + x] holds the pixels (x, page * 8) at bit 0
+** to (x, page * 8 + 7) at bit 7. Changes become visible on IOCTL_FLUSH.
+** The framebuffer is always in screen order, IOCTL_SCROLL_VERTICAL moves
+** its contents.
+*/
+#define OLED_SH1106_FB_SIZE              ( OLED_SH1106_WIDTH * OLED_SH1106_HEIGHT / 8 )
+
+// IOCTL command codes
+#define IOCTL_INIT_DISPLAY               _IO('O', 0)
+#define IOCTL_DEINIT_DISPLAY             _IO('O', 1)
+#define IOCTL_SET_CURSOR                 _IOW('O', 2, struct cursor_pos)
+#define IOCTL_NEXT_LINE                  _IO('O', 3)
+#define IOCTL_PRINT_CHAR                 _IOW('O', 4, unsigned char)
+#define IOCTL_PRINT_STRING               _IOW('O', 5, char *)   // at most 4095 characters
+#define IOCTL_INVERT_DISPLAY             _IOW('O', 6, bool)
+#define IOCTL_SET_BRIGHTNESS             _IOW('O', 7, uint8_t)
+#define IOCTL_DEACTIVATE_SCROLL          _IO('O', 10)
+#define IOCTL_FILL_DISPLAY               _IOW('O', 11, uint8_t)
+#define IOCTL_CLEAR_DISPLAY              _IO('O', 12)
+#define IOCTL_PRINT_LOGO                 _IO('O', 13)
+#define IOCTL_FLUSH                      _IOW('O', 14, struct oled_rect)
+#define IOCTL_DISPLAY_LIST               _IOW('O', 15, struct oled_display_list)
+#define IOCTL_SCROLL_VERTICAL            _IOW('O', 16, __s32)
+#define IOCTL_CONSOLE_VIEW               _IOW('O', 17, __s32)   // scrollback lines to show, 0 = live
+#define IOCTL_UPLOAD                     _IOW('O', 18, struct oled_upload)
+#define IOCTL_ANIM_LOAD                  _IOW('O', 19, struct oled_anim)
+#define IOCTL_ANIM_PLAY                  _IOW('O', 20, __u32)   // OLED_ANIM_*
+#define IOCTL_ANIM_WAIT                  _IO('O', 21)           // blocks until playback has ended
+#define IOCTL_SET_FONT                   _IOW('O', 22, __u32)   // font slot for the text calls
+#define IOCTL_LOAD_FONT                  _IOW('O', 23, struct oled_font_load)
+#define IOCTL_UPDATE_RECT                _IOW('O', 24, struct oled_image)
+#define IOCTL_FRAME_SEQ                  _IOR('O', 25, struct oled_frame_seq)
+#define IOCTL_WAIT_FRAME                 _IOW('O', 26, __u64)   // blocks until that frame is on the panel
+#define IOCTL_SET_EVENTFD                _IOW('O', 27, __s32)   // -1 removes it
+#define IOCTL_SET_QUEUE                  _IOW('O', 28, struct oled_queue)
+#define IOCTL_GET_QUEUE                  _IOR('O', 29, struct oled_queue)
+#define IOCTL_UPDATE_PIXELS              _IOW('O', 30, struct oled_pixels)
+/*
+** IOCTL_SCROLL_VERTICAL scrolls the screen by a number of pixel rows,
+** positive moves the contents up, the exposed rows are cleared. It uses
+** the display start line, so only the exposed rows are sent to the panel.
+** IOCTL_DEACTIVATE_SCROLL returns to start line 0 with the same picture.
+** The SH1106 has no horizontal scroll engine, numbers 8 and 9 are unused.
+*/
+
+
+// Structures for complex IOCTL commands
+struct cursor_pos
+{
+    uint8_t line_no;
+    uint8_t cursor_pos;
+};
+
+/*
+** Damage rectangle in pixels. A zero width or height flushes the whole
+** framebuffer.
+*/
+struct oled_rect
+{
+    uint8_t x;
+    uint8_t y;
+    uint8_t width;
+    uint8_t height;
+};
+
+/*
+** Display list: IOCTL_DISPLAY_LIST applies up to OLED_DL_MAX_OPS drawing
+** operations to the framebuffer in order and flushes once at the end.
+** Processing stops at the first failing operation.
+**
+** The drawing operations clip at the screen edges and draw every pixel
+** once, so OLED_COLOR_INVERT can be used to draw and erase overlays.
+*/
+#define OLED_OP_CURSOR                   0   // x = column, y = line
+#define OLED_OP_TEXT                     1   // data = characters, len = count
+#define OLED_OP_FILL                     2   // value = byte written to every column
+#define OLED_OP_INVERT                   3   // value = 0 normal, 1 inverted
+#define OLED_OP_BRIGHTNESS               4   // value = contrast
+#define OLED_OP_BLIT                     5   // x, y, w, h in pixels, data = page format bitmap, rop = OLED_ROP_*
+#define OLED_OP_CLEAR                    6   // clear screen, cursor to 0,0
+#define OLED_OP_SCROLL                   7   // y = rows, as IOCTL_SCROLL_VERTICAL
+#define OLED_OP_PIXEL                    8   // x, y, value = color
+#define OLED_OP_LINE                     9   // from x, y to x + w, y + h, value = color
+#define OLED_OP_RECT                     10  // outline of x, y, w, h, value = color
+#define OLED_OP_FILL_RECT                11  // x, y, w, h, value = color
+#define OLED_OP_CIRCLE                   12  // centre x, y, radius w, value = color
+#define OLED_OP_FILL_CIRCLE              13  // centre x, y, radius w, value = color
+#define OLED_OP_FONT                     14  // value = font slot, as IOCTL_SET_FONT
+#define OLED_OP_IMAGE                    15  // x, y, w, h, data = linear 1 bpp rows, rop = OLED_ROP_*
+
+// Raster ops of OLED_OP_BLIT and OLED_OP_IMAGE, how a source pixel combines with the screen
+#define OLED_ROP_COPY                    0   // screen = source
+#define OLED_ROP_OR                      1   // lit source pixels are set
+#define OLED_ROP_AND                     2   // dark source pixels are cleared
+#define OLED_ROP_XOR                     3   // lit source pixels are flipped
+
+// Colors of the drawing operations
+#define OLED_COLOR_BLACK                 0   // pixel off
+#define OLED_COLOR_WHITE                 1   // pixel lit
+#define OLED_COLOR_INVERT                2   // pixel flipped
+
+#define OLED_DL_MAX_OPS                  256
+#define OLED_DL_MAX_DATA                 OLED_SH1106_FB_SIZE
+
+/*
+** One display list operation. For OLED_OP_BLIT the bitmap holds
+** ( h + 7 ) / 8 rows of w bytes in framebuffer layout, bits past h in
+** the last row are ignored. x and y may be any pixel position, the
+** bitmap is clipped at the screen edges. OLED_OP_IMAGE takes the same
+** linear layout as IOCTL_UPDATE_RECT with a stride of ( w + 7 ) / 8.
+*/
+struct oled_dl_op
+{
+    __u16 op;            // OLED_OP_*
+    __u16 len;           // bytes at data
+    __s16 x;
+    __s16 y;
+    __s16 w;
+    __s16 h;
+    __u8  value;
+    __u8  rop;           // OLED_ROP_* of OLED_OP_BLIT and OLED_OP_IMAGE
+    __u8  reserved[2];   // must be 0
+    __u64 data;          // userspace pointer
+};
+
+struct oled_display_list
+{
+    __u32 count;         // number of operations
+    __u32 reserved;
+    __u64 ops;           // userspace pointer to count struct oled_dl_op
+};
+
+/*
+** Compressed frame upload: IOCTL_UPLOAD decodes a byte stream into the
+** framebuffer in framebuffer order, from page 0 column 0 on, and
+** flushes. Each code is followed by its operands:
+**
+**   0x00 - 0x3F   n + 1 literal bytes follow, n = code & 0x3F
+**   0x40 - 0x7F   one byte follows, written n + 2 times, n = code & 0x3F
+**   0x80 - 0xFF   skip n + 1 bytes, n = code & 0x7F
+**
+** With OLED_UPLOAD_XOR the decoded bytes are XORed into the framebuffer
+** instead of replacing it, so a delta against the current frame is
+** mostly skips. The stream may end before the frame does; a stream that
+** runs past the end of the frame or stops inside a code is rejected
+** with -EINVAL before anything is drawn.
+*/
+#define OLED_UPLOAD_RLE                  0   // decoded bytes replace the framebuffer
+#define OLED_UPLOAD_XOR                  1   // decoded bytes are XORed into the framebuffer
+#define OLED_UPLOAD_MAX_DATA             ( OLED_SH1106_FB_SIZE + OLED_SH1106_FB_SIZE / 64 )   // all literals
+
+struct oled_upload
+{
+    __u32 len;           // bytes at data
+    __u8  format;        // OLED_UPLOAD_*
+    __u8  reserved[3];
+    __u64 data;          // userspace pointer
+};
+
+/*
+** Partial update from a linear image: IOCTL_UPDATE_RECT combines h rows
+** of 1 bpp pixels with the framebuffer at x, y and flushes, which sends
+** only the page/column spans of the rectangle. Each row starts at a byte
+** boundary with its leftmost pixel in bit 7 (as in PBM, but a set bit is
+** a lit pixel). The rectangle may reach past the screen edges.
+*/
+#define OLED_IMAGE_MAX_DATA              ( 4 * OLED_SH1106_FB_SIZE )
+
+struct oled_image
+{
+    __s16 x;
+    __s16 y;
+    __u16 w;
+    __u16 h;
+    __u16 stride;        // bytes per row, 0 for ( w + 7 ) / 8
+    __u8  rop;           // OLED_ROP_*
+    __u8  reserved;
+    __u64 data;          // userspace pointer to h * stride bytes
+};
+
+/*
+** Partial update from a grayscale or XRGB8888 surface: IOCTL_UPDATE_PIXELS
+** reduces h rows of w pixels to 1 bpp and stores them at x, y like
+** IOCTL_UPDATE_RECT with OLED_ROP_COPY. A row is read from data + r *
+** stride, so a rectangle can be taken straight out of a larger surface.
+** OLED_PIXEL_XRGB8888 pixels are little-endian 32-bit words (bytes B, G,
+** R, X in memory, as DRM_FORMAT_XRGB8888), their luminance is
+** ( 77 R + 150 G + 29 B ) / 256.
+**
+** The ordered dither is aligned to the screen, so neighbouring updates
+** join without seams. Floyd-Steinberg diffuses the error within the
+** rectangle only. The same conversion is OLED_SH1106_Pixels() of the
+** driver core for programs that link it.
+*/
+#define OLED_PIXEL_GRAY8                 0   // one byte per pixel, 0 = black
+#define OLED_PIXEL_XRGB8888              1   // four bytes per pixel, X ignored
+
+#define OLED_DITHER_THRESHOLD            0   // lit where luminance >= level, level 0 means 128
+#define OLED_DITHER_ORDERED              1   // 8 x 8 Bayer matrix
+#define OLED_DITHER_FLOYD_STEINBERG      2   // error diffusion
+
+struct oled_pixels
+{
+    __s16 x;
+    __s16 y;
+    __u16 w;             // up to OLED_SH1106_WIDTH
+    __u16 h;             // up to OLED_SH1106_HEIGHT
+    __u32 stride;        // bytes per row, 0 for w times the pixel size
+    __u8  format;        // OLED_PIXEL_*
+    __u8  dither;        // OLED_DITHER_*
+    __u8  level;         // threshold of OLED_DITHER_THRESHOLD
+    __u8  reserved;
+    __u64 data;          // userspace pointer to the first pixel
+};
+
+/*
+** Animation playback. IOCTL_ANIM_LOAD stores a sequence of compressed
+** frames in the driver, IOCTL_ANIM_PLAY shows them at a fixed rate from
+** a kernel timer, once or in a loop, until the end or OLED_ANIM_STOP.
+** IOCTL_ANIM_WAIT returns once playback is over (or was never started),
+** -EINTR if a signal arrives first.
+**
+** data holds count records, each a struct oled_anim_frame followed by
+** len bytes in the IOCTL_UPLOAD format. Frames after the first are
+** usually OLED_UPLOAD_XOR deltas against the frame before; for a loop
+** the first frame has to replace the whole screen. Loading stops a
+** running animation, drawing calls during playback draw over it.
+*/
+#define OLED_ANIM_STOP                   0
+#define OLED_ANIM_ONCE                   1
+#define OLED_ANIM_LOOP                   2
+
+#define OLED_ANIM_MAX_FRAMES             1024
+#define OLED_ANIM_MAX_DATA               ( 256 * 1024 )
+#define OLED_ANIM_MIN_FRAME_US           5000   // 200 frames per second
+
+struct oled_anim
+{
+    __u32 count;         // frames
+    __u32 len;           // bytes at data
+    __u32 frame_us;      // time per frame
+    __u32 reserved;
+    __u64 data;          // userspace pointer to the frame records
+};
+
+struct oled_anim_frame
+{
+    __u16 len;           // bytes of compressed data that follow
+    __u8  format;        // OLED_UPLOAD_*
+    __u8  reserved;
+};
+
+/*
+** Fonts. The text calls (IOCTL_PRINT_*, OLED_OP_TEXT) draw with the font
+** of the slot chosen by IOCTL_SET_FONT, the cursor line is the top page
+** of the glyphs and IOCTL_NEXT_LINE moves down by the font height. The
+** console of write() always uses OLED_FONT_5X7.
+**
+** Slots from OLED_FONT_FIRST_LOADABLE on are filled with IOCTL_LOAD_FONT
+** (len 0 empties the slot) or, at probe, from the firmware file
+** sh1106-font<slot>.bin. A font file is a struct oled_font_header, the
+** width in columns of each character from first to last (0 if the font
+** lacks it), and then the glyphs in the same order, each pages rows of
+** width bytes in framebuffer layout. Missing characters are drawn as
+** '?' or skipped if the font has no '?' either.
+*/
+#define OLED_FONT_5X7                    0   // built-in font, 6 columns per character
+#define OLED_FONT_5X7_2X                 1   // built-in font at twice the size, 2 pages high
+#define OLED_FONT_5X7_3X                 2   // built-in font at three times the size, 3 pages high
+#define OLED_FONT_FIRST_LOADABLE         3
+#define OLED_FONT_SLOTS                  8
+#define OLED_FONT_MAX_DATA               ( 32 * 1024 )
+
+struct oled_font_header
+{
+    __u8  magic[4];      // "SHF1"
+    __u8  first;         // first character
+    __u8  last;          // last character
+    __u8  pages;         // glyph height in pages, 1 - 8
+    __u8  spacing;       // blank columns after each glyph
+};
+
+struct oled_font_load
+{
+    __u32 slot;          // OLED_FONT_FIRST_LOADABLE - OLED_FONT_SLOTS - 1
+    __u32 len;           // bytes at data, the whole font file
+    __u64 data;          // userspace pointer
+};
+
+/*
+** Frame completion. Every call that changes the screen submits a frame
+** and takes the next sequence number, the flush worker completes frames
+** when their bytes are on the bus (frames merged in the queue, see
+** below, complete together). Both counts start at 0 and only grow.
+**
+** poll()/select() report the device readable while no frame is in
+** flight and writable while a drawing call or write() would not have
+** to wait for room in the frame queue (see OLED_QUEUE_BLOCK below).
+** read() of 8 bytes returns the completed count as a __u64 once no
+** frame is in flight, or fails with -EAGAIN under O_NONBLOCK.
+** IOCTL_WAIT_FRAME blocks until the given frame has completed, 0 waits
+** for everything submitted so far; a number past the submitted count is
+** -EINVAL. A renderer one frame ahead draws frame n + 1 and then waits
+** for frame n. IOCTL_SET_EVENTFD adds 1 to the eventfd on every flush
+** that completes frames. The calls fail with -ENODEV once the panel is
+** gone, poll() reports POLLHUP.
+*/
+struct oled_frame_seq
+{
+    __u64 submitted;     // frames handed to the flush worker
+    __u64 completed;     // frames sent to the panel, including failed sends
+};
+
+/*
+** Frame queue. Every submitted frame is a copy of the screen that waits
+** in a queue of up to depth frames while an earlier one is on the bus.
+** When the queue is full the policy decides:
+**
+**   OLED_QUEUE_COALESCE     the new frame replaces the newest queued one
+**   OLED_QUEUE_DROP_OLDEST  the oldest queued frame is dropped, the panel
+**                           gets its changes with the frame after it; at
+**                           depth 1 this is the same as OLED_QUEUE_COALESCE
+**   OLED_QUEUE_BLOCK        drawing calls and write() wait for room, or
+**                           fail with -EAGAIN under O_NONBLOCK
+**
+** Either way the panel ends up with the newest picture and no change is
+** lost; only the intermediate frames differ. Frames of the animation
+** player never wait, under OLED_QUEUE_BLOCK they coalesce. The default
+** is depth 1 with OLED_QUEUE_COALESCE. IOCTL_SET_QUEUE takes depth and
+** policy, a smaller depth merges the surplus frames as dropped ones.
+** IOCTL_GET_QUEUE also returns the frames waiting and the counters.
+*/
+#define OLED_QUEUE_COALESCE              0
+#define OLED_QUEUE_DROP_OLDEST           1
+#define OLED_QUEUE_BLOCK                 2
+
+#define OLED_QUEUE_MAX_DEPTH             16
+
+struct oled_queue
+{
+    __u32 depth;         // 1 - OLED_QUEUE_MAX_DEPTH
+    __u32 policy;        // OLED_QUEUE_*
+    __u32 queued;        // frames waiting, not counting the one being sent
+    __u32 reserved;
+    __u64 dropped;       // frames dropped by OLED_QUEUE_DROP_OLDEST or a smaller depth
+    __u64 coalesced;     // frames merged into a queued one
+};
+
+#endif /* SH1106_IOCTL_H */
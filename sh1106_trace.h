@@ -0,0 +1,96 @@
+/*
+** Trace events of the SH1106 OLED driver, enable them with
+**   echo 1 > /sys/kernel/tracing/events/sh1106/enable
+*/
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sh1106
+
+#if !defined(SH1106_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define SH1106_TRACE_H
+
+#include <linux/tracepoint.h>
+
+// One bus transfer handed to the controller, an SPI message or I2C write
+TRACE_EVENT(sh1106_xfer_submit,
+    TP_PROTO(int minor, bool is_cmd, size_t len),
+    TP_ARGS(minor, is_cmd, len),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(bool, is_cmd)
+        __field(size_t, len)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->is_cmd = is_cmd;
+        __entry->len = len;
+    ),
+    TP_printk("panel=%d %s len=%zu", __entry->minor,
+              __entry->is_cmd ? "cmd" : "data", __entry->len)
+);
+
+// The transfer completed, duration is the time spent in the bus backend
+TRACE_EVENT(sh1106_xfer_done,
+    TP_PROTO(int minor, bool is_cmd, size_t len, int ret, u64 duration_ns),
+    TP_ARGS(minor, is_cmd, len, ret, duration_ns),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(bool, is_cmd)
+        __field(size_t, len)
+        __field(int, ret)
+        __field(u64, duration_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->is_cmd = is_cmd;
+        __entry->len = len;
+        __entry->ret = ret;
+        __entry->duration_ns = duration_ns;
+    ),
+    TP_printk("panel=%d %s len=%zu ret=%d duration=%lluns", __entry->minor,
+              __entry->is_cmd ? "cmd" : "data", __entry->len, __entry->ret,
+              __entry->duration_ns)
+);
+
+// The flush worker starts sending, pages is the number of dirty pages
+TRACE_EVENT(sh1106_flush_start,
+    TP_PROTO(int minor, unsigned int pages),
+    TP_ARGS(minor, pages),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(unsigned int, pages)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->pages = pages;
+    ),
+    TP_printk("panel=%d pages=%u", __entry->minor, __entry->pages)
+);
+
+// The flush worker is done, latency counts from the first OLED_SH1106_Flush()
+TRACE_EVENT(sh1106_flush_done,
+    TP_PROTO(int minor, size_t bytes, int ret, u64 latency_ns),
+    TP_ARGS(minor, bytes, ret, latency_ns),
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(size_t, bytes)
+        __field(int, ret)
+        __field(u64, latency_ns)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->bytes = bytes;
+        __entry->ret = ret;
+        __entry->latency_ns = latency_ns;
+    ),
+    TP_printk("panel=%d bytes=%zu ret=%d latency=%lluns", __entry->minor,
+              __entry->bytes, __entry->ret, __entry->latency_ns)
+);
+
+#endif /* SH1106_TRACE_H */
+
+// The header is not in include/trace/events, tell define_trace.h where it is
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sh1106_trace
+#include <trace/define_trace.h>
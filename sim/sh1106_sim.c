@@ -0,0 +1,467 @@
+/*
+** Userspace SH1106 emulator, see sh1106_sim.h.
+*/
+#include <stddef.h>
+#include <string.h>
+
+#include "sh1106_sim.h"
+
+#define to_sim(p)   ( (struct sh1106_sim *)( (char *)(p) - offsetof( struct sh1106_sim, panel ) ) )
+
+
+/****************************************************************************
+ * Name: sh1106_sim_command
+ *
+ * Details : Decodes one command byte as the SH1106 does. Commands that
+ *           take a parameter keep the first byte in pending until the
+ *           parameter arrives.
+ ****************************************************************************/
+static void sh1106_sim_command( struct sh1106_sim *sim, uint8_t c )
+{
+  if( sim->pending != 0u )
+  {
+    if( sim->pending == 0x81 )
+    {
+      sim->contrast = c;
+    }
+    else if( sim->pending == 0xAD )
+    {
+      sim->dcdc_on = ( ( c & 0x01 ) != 0u );
+    }
+    // multiplex, offset, clock, pre-charge, COM pads and VCOM
+    // parameters do not change the picture
+    sim->pending = 0u;
+    return;
+  }
+
+  if( c <= 0x0F )
+  {
+    sim->column = ( sim->column & 0xF0 ) | c;               // column low nibble
+  }
+  else if( c <= 0x1F )
+  {
+    sim->column = ( ( c & 0x0F ) << 4 ) | ( sim->column & 0x0F );   // column high nibble
+  }
+  else if( ( c >= 0x30 ) && ( c <= 0x33 ) )
+  {
+    // pump voltage
+  }
+  else if( ( c >= 0x40 ) && ( c <= 0x7F ) )
+  {
+    sim->start_line = c & 0x3F;
+  }
+  else if( ( c >= 0xB0 ) && ( c <= 0xB7 ) )
+  {
+    sim->page = c & 0x07;
+  }
+  else
+  {
+    switch( c )
+    {
+      case 0x81: case 0xA8: case 0xAD: case 0xD3:
+      case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+        sim->pending = c;
+        break;
+      case 0xA0: case 0xA1:                  // segment remap
+      case 0xC0: case 0xC8:                  // COM scan direction
+      case 0xE0: case 0xEE: case 0xE3:       // read-modify-write, NOP
+        break;
+      case 0xA4: case 0xA5:
+        sim->entire_on = ( c == 0xA5 );
+        break;
+      case 0xA6: case 0xA7:
+        sim->inverted = ( c == 0xA7 );
+        break;
+      case 0xAE: case 0xAF:
+        sim->display_on = ( c == 0xAF );
+        break;
+      default:
+        sim->count.unknown_cmds++;           // e.g. SSD1306 only commands
+        break;
+    }
+  }
+}
+
+
+// Takes one command or display data byte
+static void sh1106_sim_byte( struct sh1106_sim *sim, bool data, uint8_t b )
+{
+  if( data == false )
+  {
+    sim->count.cmd_bytes++;
+    sh1106_sim_command( sim, b );
+    return;
+  }
+
+  sim->count.data_bytes++;
+  if( sim->column >= SH1106_SIM_COLS )
+  {
+    sim->count.overruns++;
+    return;
+  }
+  sim->ram[sim->page][sim->column++] = b;
+}
+
+
+static int sh1106_sim_bus_write( struct sh1106_panel *panel, const uint8_t *buf, size_t len )
+{
+  struct sh1106_sim *sim = to_sim( panel );
+  size_t i;
+
+  sim->count.transfers++;
+
+  if( sim->in_reset )
+  {
+    sim->count.ignored += len;
+    return( 0 );
+  }
+
+  for( i = 0; i < len; i++ )
+  {
+    sh1106_sim_byte( sim, sim->dc != 0, buf[i] );
+  }
+
+  return( 0 );
+}
+
+/****************************************************************************
+ * Name: sh1106_sim_i2c_receive
+ *
+ * Details : Decodes one I2C write to the panel as the SH1106 does, msg
+ *           being the bytes after the slave address. A control byte with
+ *           Co clear makes the rest of the message commands or data, as
+ *           its D/C# bit says; with Co set it covers only the next byte,
+ *           and another control byte follows.
+ ****************************************************************************/
+void sh1106_sim_i2c_receive( struct sh1106_sim *sim, const uint8_t *msg, size_t len )
+{
+  size_t i = 0;
+  uint8_t ctrl;
+
+  sim->count.transfers++;
+  sim->count.i2c_bytes += len + 1u;   // slave address
+
+  if( sim->in_reset )
+  {
+    sim->count.ignored += len;
+    return;
+  }
+
+  while( i < len )
+  {
+    ctrl = msg[i++];
+    if( ctrl & SH1106_I2C_CO )
+    {
+      if( i < len )
+      {
+        sh1106_sim_byte( sim, ( ctrl & SH1106_I2C_DATA ) != 0u, msg[i++] );
+      }
+      continue;
+    }
+    while( i < len )
+    {
+      sh1106_sim_byte( sim, ( ctrl & SH1106_I2C_DATA ) != 0u, msg[i++] );
+    }
+  }
+}
+
+/****************************************************************************
+ * Name: sh1106_sim_i2c_write
+ *
+ * Details : I2C host side, frames a write like the kernel's I2C backend:
+ *           a control byte for the DC level of the panel, then up to a
+ *           page of payload per message.
+ ****************************************************************************/
+static int sh1106_sim_i2c_write( struct sh1106_panel *panel, const uint8_t *buf, size_t len )
+{
+  struct sh1106_sim *sim = to_sim( panel );
+  size_t n;
+
+  while( len > 0u )
+  {
+    n = ( len > SH1106_I2C_MAX_DATA ) ? SH1106_I2C_MAX_DATA : len;
+    sim->i2c_msg[0] = ( panel->dc_state == 1 ) ? SH1106_I2C_DATA : 0x00;
+    memcpy( &sim->i2c_msg[1], buf, n );
+    sh1106_sim_i2c_receive( sim, sim->i2c_msg, n + 1u );
+    buf += n;
+    len -= n;
+  }
+
+  return( 0 );
+}
+
+
+static void sh1106_sim_bus_set_dc( struct sh1106_panel *panel, int value )
+{
+  struct sh1106_sim *sim = to_sim( panel );
+
+  if( sim->dc != value )
+  {
+    sim->count.dc_toggles++;
+  }
+  sim->dc = value;
+}
+
+
+static void sh1106_sim_bus_set_reset( struct sh1106_panel *panel, int value )
+{
+  struct sh1106_sim *sim = to_sim( panel );
+
+  if( ( value != 0 ) && ( sim->in_reset == false ) )
+  {
+    // registers go back to their power on values, the RAM is kept
+    sim->count.resets++;
+    sim->page       = 0u;
+    sim->column     = 0u;
+    sim->start_line = 0u;
+    sim->contrast   = 0x80;
+    sim->pending    = 0u;
+    sim->display_on = false;
+    sim->inverted   = false;
+    sim->entire_on  = false;
+    sim->dcdc_on    = true;     // power on value
+  }
+  sim->in_reset = ( value != 0 );
+}
+
+
+static void sh1106_sim_bus_delay_us( struct sh1106_panel *panel, unsigned int us )
+{
+  to_sim( panel )->count.delay_us += us;
+}
+
+
+static void sh1106_sim_bus_flush( struct sh1106_panel *panel )
+{
+  struct sh1106_sim *sim = to_sim( panel );
+  struct sh1106_frame frame;
+  size_t bytes;
+
+  panel->stats.requests++;
+  if( OLED_SH1106_Snapshot( panel, &frame ) == 0u )
+  {
+    return;
+  }
+
+  sim->count.flushes++;
+  if( OLED_SH1106_Send( panel, &frame, &bytes ) < 0 )
+  {
+    panel->stats.dropped++;
+  }
+  else
+  {
+    panel->stats.flushes++;
+  }
+}
+
+
+static const struct sh1106_bus_ops sh1106_sim_ops = {
+  .write     = sh1106_sim_bus_write,
+  .set_dc    = sh1106_sim_bus_set_dc,
+  .set_reset = sh1106_sim_bus_set_reset,
+  .delay_us  = sh1106_sim_bus_delay_us,
+  .flush     = sh1106_sim_bus_flush,
+};
+
+// I2C panel: no DC line, the level goes into the control bytes
+static const struct sh1106_bus_ops sh1106_sim_i2c_ops = {
+  .write     = sh1106_sim_i2c_write,
+  .set_reset = sh1106_sim_bus_set_reset,
+  .delay_us  = sh1106_sim_bus_delay_us,
+  .flush     = sh1106_sim_bus_flush,
+};
+
+/****************************************************************************
+ * Name: sh1106_sim_init
+ *
+ * Details : Sets up an emulated panel in power on state with the driver
+ *           core attached. OLED_SH1106_DisplayInit( &sim->panel ) brings
+ *           it up like the kernel driver does.
+ ****************************************************************************/
+void sh1106_sim_init( struct sh1106_sim *sim )
+{
+  OLED_SH1106_BuildGlyphCache();
+
+  memset( sim, 0, sizeof(*sim) );
+  sim->panel.fb       = sim->fb;
+  sim->panel.front    = sim->front;
+  sim->panel.shown    = sim->shown;
+  sim->panel.con_text = sim->con_text;
+  OLED_SH1106_InitPanel( &sim->panel, &sh1106_sim_ops );
+
+  sim->dc       = -1;
+  sim->contrast = 0x80;
+  sim->dcdc_on  = true;
+}
+
+
+void sh1106_sim_init_i2c( struct sh1106_sim *sim )
+{
+  sh1106_sim_init( sim );
+  OLED_SH1106_InitPanel( &sim->panel, &sh1106_sim_i2c_ops );
+}
+
+
+void sh1106_sim_reset_counters( struct sh1106_sim *sim )
+{
+  memset( &sim->count, 0, sizeof(sim->count) );
+  memset( &sim->panel.stats, 0, sizeof(sim->panel.stats) );
+}
+
+/****************************************************************************
+ * Name: sh1106_sim_power_loss
+ *
+ * Details : Cuts the supply of the emulated controller and brings it back:
+ *           the registers return to their power on values and the display
+ *           RAM holds garbage. The core is not told, as with a real
+ *           system sleep.
+ ****************************************************************************/
+void sh1106_sim_power_loss( struct sh1106_sim *sim )
+{
+  unsigned int page, x;
+
+  for( page = 0; page < SH1106_PAGES; page++ )
+  {
+    for( x = 0; x < SH1106_SIM_COLS; x++ )
+    {
+      sim->ram[page][x] = (uint8_t)( ( page * 131u + x * 71u ) ^ 0x5Au );
+    }
+  }
+  sim->page       = 0u;
+  sim->column     = 0u;
+  sim->start_line = 0u;
+  sim->contrast   = 0x80;
+  sim->pending    = 0u;
+  sim->display_on = false;
+  sim->inverted   = false;
+  sim->entire_on  = false;
+  sim->dcdc_on    = true;
+}
+
+/****************************************************************************
+ * Name: sh1106_sim_screen
+ *
+ * Details : Returns what the panel shows, one byte per pixel, 1 = lit.
+ *           Screen column x is RAM column x + 2 and screen row y is RAM
+ *           row ( y + start line ) % 64, as on the usual 128 x 64 modules.
+ ****************************************************************************/
+void sh1106_sim_screen( const struct sh1106_sim *sim, uint8_t screen[SH1106_SIM_ROWS][SH1106_MAX_SEG] )
+{
+  unsigned int x, y, row;
+  uint8_t lit;
+
+  for( y = 0; y < SH1106_SIM_ROWS; y++ )
+  {
+    row = ( y + sim->start_line ) % SH1106_SIM_ROWS;
+    for( x = 0; x < SH1106_MAX_SEG; x++ )
+    {
+      lit = ( sim->ram[row / 8][x + 2] >> ( row % 8 ) ) & 1u;
+      if( sim->entire_on )
+      {
+        lit = 1u;
+      }
+      else if( sim->inverted )
+      {
+        lit ^= 1u;
+      }
+      screen[y][x] = ( sim->display_on && ( sim->in_reset == false ) ) ? lit : 0u;
+    }
+  }
+}
+
+/****************************************************************************
+ * Name: sh1106_sim_check
+ *
+ * Details : Compares the picture in the display RAM with the framebuffer
+ *           of the core, ignoring inversion and display on/off. Call it
+ *           after a flush.
+ *
+ * Return  : Number of pixels that differ
+ ****************************************************************************/
+int sh1106_sim_check( const struct sh1106_sim *sim )
+{
+  unsigned int x, y, row;
+  int diff = 0;
+
+  for( y = 0; y < SH1106_SIM_ROWS; y++ )
+  {
+    row = ( y + sim->start_line ) % SH1106_SIM_ROWS;
+    for( x = 0; x < SH1106_MAX_SEG; x++ )
+    {
+      if( ( ( sim->ram[row / 8][x + 2] >> ( row % 8 ) ) & 1u ) !=
+          ( ( sim->fb[y / 8][x] >> ( y % 8 ) ) & 1u ) )
+      {
+        diff++;
+      }
+    }
+  }
+
+  return( diff );
+}
+
+/****************************************************************************
+ * Name: sh1106_sim_write_pbm
+ *
+ * Details : Writes the picture the panel shows as a binary PBM image.
+ *           Lit pixels are white, like on the panel.
+ *
+ * Return  : 0 on success, -1 if the file could not be written
+ ****************************************************************************/
+int sh1106_sim_write_pbm( const struct sh1106_sim *sim, const char *path )
+{
+  uint8_t screen[SH1106_SIM_ROWS][SH1106_MAX_SEG];
+  uint8_t line[SH1106_MAX_SEG / 8];
+  unsigned int x, y;
+  FILE *f;
+  int ret = 0;
+
+  sh1106_sim_screen( sim, screen );
+
+  f = fopen( path, "wb" );
+  if( f == NULL )
+  {
+    return( -1 );
+  }
+
+  fprintf( f, "P4\n%d %d\n", SH1106_MAX_SEG, SH1106_SIM_ROWS );
+  for( y = 0; y < SH1106_SIM_ROWS; y++ )
+  {
+    memset( line, 0, sizeof(line) );
+    for( x = 0; x < SH1106_MAX_SEG; x++ )
+    {
+      if( screen[y][x] == 0u )
+      {
+        line[x / 8] |= 0x80 >> ( x % 8 );   // PBM: 1 is black
+      }
+    }
+    if( fwrite( line, sizeof(line), 1, f ) != 1 )
+    {
+      ret = -1;
+    }
+  }
+
+  if( fclose( f ) != 0 )
+  {
+    ret = -1;
+  }
+  return( ret );
+}
+
+
+void sh1106_sim_print_counters( const struct sh1106_sim *sim, FILE *out )
+{
+  fprintf( out, "transfers:    %llu\n", (unsigned long long)sim->count.transfers );
+  fprintf( out, "cmd_bytes:    %llu\n", (unsigned long long)sim->count.cmd_bytes );
+  fprintf( out, "data_bytes:   %llu\n", (unsigned long long)sim->count.data_bytes );
+  fprintf( out, "dc_toggles:   %llu\n", (unsigned long long)sim->count.dc_toggles );
+  fprintf( out, "resets:       %llu\n", (unsigned long long)sim->count.resets );
+  fprintf( out, "delay_us:     %llu\n", (unsigned long long)sim->count.delay_us );
+  fprintf( out, "flushes:      %llu\n", (unsigned long long)sim->count.flushes );
+  fprintf( out, "unknown_cmds: %llu\n", (unsigned long long)sim->count.unknown_cmds );
+  fprintf( out, "overruns:     %llu\n", (unsigned long long)sim->count.overruns );
+  fprintf( out, "ignored:      %llu\n", (unsigned long long)sim->count.ignored );
+  if( sim->count.i2c_bytes != 0u )
+  {
+    fprintf( out, "i2c_bytes:    %llu\n", (unsigned long long)sim->count.i2c_bytes );
+  }
+}
@@ -0,0 +1,83 @@
+/*
+** Userspace SH1106 emulator. It plugs into the driver core as a bus
+** (struct sh1106_bus_ops) and models what the controller does with the
+** bytes: the command decoder, page/column addressing, the 132 x 64 bit
+** display RAM, start line, contrast, inversion and display on/off. Every
+** transfer is counted, and the picture the panel would show can be
+** compared against the framebuffer or written out as a PBM image.
+**
+** Flushes are synchronous: OLED_SH1106_Flush() sends the frame before it
+** returns.
+**
+** sh1106_sim_init_i2c() attaches the core through the I2C framing instead
+** of the DC line: every write becomes messages of a control byte and up
+** to a page of payload, which the emulated controller decodes as the
+** SH1106 does, including control bytes with Co set.
+*/
+#ifndef SH1106_SIM_H
+#define SH1106_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sh1106_core.h"
+
+#define SH1106_SIM_COLS        ( 132 )   // Columns of the SH1106 display RAM
+#define SH1106_SIM_ROWS        (  64 )
+
+struct sh1106_sim_counters
+{
+    uint64_t transfers;                       // bus writes
+    uint64_t cmd_bytes;
+    uint64_t data_bytes;
+    uint64_t dc_toggles;
+    uint64_t resets;                          // reset pulses
+    uint64_t delay_us;                        // time the driver asked to sleep
+    uint64_t flushes;                         // frames handed to the bus
+    uint64_t unknown_cmds;                    // bytes that are no SH1106 command
+    uint64_t overruns;                        // data written past column 131
+    uint64_t ignored;                         // bytes sent while held in reset
+    uint64_t i2c_bytes;                       // bytes on the I2C bus: address, control bytes and payload
+};
+
+struct sh1106_sim
+{
+    struct sh1106_panel panel;                // driver core, attached to the emulated bus
+
+    // buffers of the core
+    uint8_t fb[SH1106_PAGES][SH1106_MAX_SEG];
+    uint8_t front[SH1106_PAGES][SH1106_MAX_SEG];
+    uint8_t shown[SH1106_PAGES][SH1106_MAX_SEG];
+    char    con_text[SH1106_CON_LINES][SH1106_CON_COLS];
+
+    // emulated controller
+    uint8_t ram[SH1106_PAGES][SH1106_SIM_COLS];
+    uint8_t page;
+    uint8_t column;
+    uint8_t start_line;
+    uint8_t contrast;
+    uint8_t pending;                          // first byte of a two byte command, 0 if none
+    int     dc;                               // DC line level
+    bool    in_reset;
+    bool    display_on;
+    bool    inverted;
+    bool    entire_on;                        // 0xA5, all pixels lit
+    bool    dcdc_on;                          // DC-DC converter, 0xAD 0x8B on, 0xAD 0x8A off
+
+    uint8_t i2c_msg[1 + SH1106_I2C_MAX_DATA]; // message being sent over I2C
+
+    struct sh1106_sim_counters count;
+};
+
+void sh1106_sim_init( struct sh1106_sim *sim );
+void sh1106_sim_init_i2c( struct sh1106_sim *sim );
+void sh1106_sim_i2c_receive( struct sh1106_sim *sim, const uint8_t *msg, size_t len );
+void sh1106_sim_reset_counters( struct sh1106_sim *sim );
+void sh1106_sim_power_loss( struct sh1106_sim *sim );
+void sh1106_sim_screen( const struct sh1106_sim *sim, uint8_t screen[SH1106_SIM_ROWS][SH1106_MAX_SEG] );
+int  sh1106_sim_check( const struct sh1106_sim *sim );
+int  sh1106_sim_write_pbm( const struct sh1106_sim *sim, const char *path );
+void sh1106_sim_print_counters( const struct sh1106_sim *sim, FILE *out );
+
+#endif /* SH1106_SIM_H */